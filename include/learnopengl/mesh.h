@@ -6,8 +6,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include <learnopengl/shader_m.h>
+#include <rg/GeometryArena.h>
+#include <rg/RenderQueue.h>
+#include <rg/TextureRegistry.h>
+#include <rg/VertexPacking.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,92 +31,344 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// Compact layout of Vertex, 20 instead of 56 bytes. The vertex shader decodes it when `packedVertex` is set.
+struct PackedVertex {
+    // position quantized to the mesh bounds (unorm16), w holds the bitangent sign (0 = -1, 65535 = +1)
+    uint16_t Position[4];
+    // octahedral-encoded normal (snorm16)
+    int16_t Normal[2];
+    // half float texCoords
+    uint16_t TexCoords[2];
+    // octahedral-encoded tangent (snorm16), the bitangent is rebuilt from normal, tangent and sign
+    int16_t Tangent[2];
+};
+
+// vertex layout a mesh is uploaded with, chosen per model
+enum class VertexFormat {
+    Full,
+    Packed
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// what a material texture is used for, in the order of the texture_<slot>N sampler names
+enum class TextureSlot : uint8_t {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+// Fixed sampler-to-unit assignment: texture_<slot>N is always bound to unit (N - 1) * slots + slot, so the
+// samplers of a program are set once (setMaterialSamplers) instead of per draw. texture_diffuse1 and
+// texture_specular1 land on units 0 and 1, where multi_lights.fs expects material.diffuse and material.specular.
+const unsigned int MaxMaterialUnits = 16;
+
+inline unsigned int materialUnit(TextureSlot slot, unsigned int number)
+{
+    return (number - 1) * (unsigned int)TextureSlot::Count + (unsigned int)slot;
+}
+
+// points every texture_<slot>N sampler the program has at its unit, call once after linking
+inline void setMaterialSamplers(const Shader &shader)
+{
+    static const char *slotNames[(unsigned int)TextureSlot::Count] = {
+        "texture_diffuse", "texture_specular", "texture_normal", "texture_height"
+    };
+    shader.use();
+    for(unsigned int unit = 0; unit < MaxMaterialUnits; unit++)
+    {
+        unsigned int slot = unit % (unsigned int)TextureSlot::Count;
+        string name = slotNames[slot] + std::to_string(unit / (unsigned int)TextureSlot::Count + 1);
+        Shader::Uniform sampler = shader.findUniform(name);
+        if(sampler.location >= 0)
+            shader.setInt(sampler, (int)unit);
+    }
+}
+
+// one row of a mesh's material binding table, resolved when the mesh is set up
+struct TextureBinding {
+    unsigned int texture; // GL name
+    uint8_t unit;
+    TextureSlot slot;
+};
+
+// CPU-side mesh data produced by the importer, before any GL objects exist.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures; // only type and path are known until the model is uploaded
+    vector<vector<unsigned int>> lods; // coarser levels of detail over the same vertices, finest first
+};
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, vertices and indices are only kept after the upload if the mesh was created with keepData
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    VertexFormat         format;
+    unsigned int VAO; // shared by every mesh with the same vertex format, see rg::GeometryArena
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, takes ownership of the arrays (pass them with std::move to avoid copying)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         VertexFormat format = VertexFormat::Full, bool keepData = false)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->format = format;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+
+        // the GPU has its own copy, only consumers like collision or picking need the CPU one
+        if(!keepData)
+        {
+            vector<Vertex>().swap(this->vertices);
+            vector<unsigned int>().swap(this->indices);
+        }
+    }
+
+    // bytes held in RAM by the vertex and index arrays
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+    }
+
+    // bytes of the vertex and index buffers, all levels of detail included
+    size_t gpuBytes() const
+    {
+        size_t bytes = vertexBufferBytes;
+        for(const rg::GeometryArena::Range &range : ranges)
+            bytes += range.indexCount * rg::GeometryArena::indexSize(range.indexType);
+        return bytes;
+    }
+
+    // uploads a coarser level of detail, an index buffer over the same vertices
+    void addLod(const vector<unsigned int> &lodIndices)
+    {
+        vector<unsigned short> shortIndices;
+        const void *indexData = lodIndices.data();
+        GLenum indexType = shortIndexType(lodIndices, shortIndices, indexData);
+        ranges.push_back(rg::GeometryArena::instance().allocateIndices(*layout, ranges.front(), indexData, lodIndices.size(), indexType));
+    }
+
+    // number of levels of detail, the full mesh included
+    unsigned int lodCount() const
+    {
+        return (unsigned int)ranges.size();
+    }
+
+    size_t triangleCount(unsigned int lod = 0) const
+    {
+        return ranges[std::min(lod, lodCount() - 1)].indexCount / 3;
+    }
+
+    // object space bounding box
+    const glm::vec3& boundsMin() const
+    {
+        return minimum;
+    }
+
+    const glm::vec3& boundsMax() const
+    {
+        return maximum;
     }
 
     // render the mesh
     void Draw(Shader &shader) 
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        rg::GLState::instance().bindVertexArray(VAO);
+        DrawRange(shader);
+    }
+
+    // render the mesh's range of the arena buffers, expects VAO to be bound already (Model binds it once for all meshes).
+    // Meshes with fewer levels of detail than `lod` draw their coarsest one.
+    void DrawRange(const Shader &shader, unsigned int lod = 0)
+    {
+        // bind appropriate textures, units that already hold them are skipped
+        for(const TextureBinding &binding : bindings)
+            rg::GLState::instance().bindTexture(binding.unit, GL_TEXTURE_2D, binding.texture);
+
+        DrawGeometry(shader, lod);
+    }
+
+    // points the material at the textures rg::TextureRegistry merged its own into
+    void ResolveTextures()
+    {
+        const rg::TextureRegistry &registry = rg::TextureRegistry::instance();
+        for(Texture &texture : textures)
+            texture.id = registry.resolve(texture.id);
+        for(TextureBinding &binding : bindings)
+            binding.texture = registry.resolve(binding.texture);
+    }
+
+    // hands the mesh to `queue`, which binds its VAO and textures before drawing it at `model`.
+    // `center` is the point the queue orders it by.
+    void Submit(rg::RenderQueue &queue, const Shader &shader, const glm::mat4 &model, unsigned int lod, const glm::vec3 &center) const
+    {
+        rg::RenderQueue::Item item;
+        item.shader = &shader;
+        item.vao = VAO;
+        for(const TextureBinding &binding : bindings)
+            if(binding.unit < rg::RenderQueue::MaxTextures)
+                item.textures[binding.unit] = binding.texture;
+        item.model = model;
+        item.draw = drawQueued;
+        item.object = this;
+        item.count = lod;
+        // meshes with textures on units the queue doesn't bind need drawQueued
+        if(unitsUsed <= rg::RenderQueue::MaxTextures)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            item.range = &ranges[std::min(lod, lodCount() - 1)];
+            if(format == VertexFormat::Packed)
+            {
+                item.positionScale = glm::vec4(positionScale, 1.0f);
+                item.positionOffset = glm::vec4(positionOffset, 0.0f);
+            }
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        queue.submit(rg::RenderQueue::Opaque, item, center);
     }
 
 private:
     // render data 
-    unsigned int VBO, EBO;
+    vector<rg::GeometryArena::Range> ranges; // finest level of detail first
+    vector<TextureBinding> bindings; // the material, one entry per texture
+    unsigned int unitsUsed = 0; // highest unit in bindings + 1
+    const rg::VertexLayout *layout = nullptr;
+    size_t vertexBufferBytes = 0;
+    size_t vertexCount = 0;
+    glm::vec3 minimum = glm::vec3(0.0f);
+    glm::vec3 maximum = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+
+    // everything but the texture binds: packed vertex uniforms and the draw call
+    void DrawGeometry(const Shader &shader, unsigned int lod) const
+    {
+        static constexpr Shader::UniformName packedVertex("packedVertex");
+        static constexpr Shader::UniformName positionScaleName("positionScale");
+        static constexpr Shader::UniformName positionOffsetName("positionOffset");
+
+        // packed positions are relative to the mesh bounds
+        if(format == VertexFormat::Packed)
+        {
+            shader.setBool(packedVertex, true);
+            shader.setVec3(positionScaleName, positionScale);
+            shader.setVec3(positionOffsetName, positionOffset);
+        }
+
+        // draw mesh
+        rg::GeometryArena::draw(ranges[std::min(lod, lodCount() - 1)]);
+
+        // the same shader also draws plain float geometry
+        if(format == VertexFormat::Packed)
+            shader.setBool(packedVertex, false);
+    }
 
-    // initializes all the buffer objects/arrays
+    static void drawQueued(const rg::RenderQueue::Item &item)
+    {
+        const Mesh &mesh = *(const Mesh*)item.object;
+        // the queue only binds the first few units
+        for(const TextureBinding &binding : mesh.bindings)
+            if(binding.unit >= rg::RenderQueue::MaxTextures)
+                rg::GLState::instance().bindTexture(binding.unit, GL_TEXTURE_2D, binding.texture);
+        mesh.DrawGeometry(*item.shader, item.count);
+    }
+
+    // appends the vertices and indices to the scene's shared buffers
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        // the material binding table, texture_<slot>N goes to materialUnit(slot, N)
+        unsigned int numbers[(unsigned int)TextureSlot::Count] = { 1, 1, 1, 1 };
+        bindings.clear();
+        unitsUsed = 0;
+        for(const Texture &texture : textures)
+        {
+            TextureSlot slot;
+            const string &name = texture.type;
+            if(name == "texture_diffuse")
+                slot = TextureSlot::Diffuse;
+            else if(name == "texture_specular")
+                slot = TextureSlot::Specular;
+            else if(name == "texture_normal")
+                slot = TextureSlot::Normal;
+            else if(name == "texture_height")
+                slot = TextureSlot::Height;
+            else
+                continue;
+            unsigned int unit = materialUnit(slot, numbers[(unsigned int)slot]++);
+            if(unit >= MaxMaterialUnits)
+                continue;
+            bindings.push_back(TextureBinding{ texture.id, (uint8_t)unit, slot });
+            unitsUsed = std::max(unitsUsed, unit + 1);
+        }
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        minimum = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        maximum = minimum;
+        for(const Vertex &vertex : vertices)
+        {
+            minimum = glm::min(minimum, vertex.Position);
+            maximum = glm::max(maximum, vertex.Position);
+        }
+        vertexCount = vertices.size();
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        vector<unsigned short> shortIndices;
+        const void *indexData = indices.data();
+        GLenum indexType = shortIndexType(indices, shortIndices, indexData);
 
+        rg::GeometryArena::Range range;
+        if(format == VertexFormat::Packed)
+        {
+            vector<PackedVertex> packed = packVertices();
+            layout = &packedLayout();
+            vertexBufferBytes = packed.size() * sizeof(PackedVertex);
+            range = rg::GeometryArena::instance().allocate(*layout, packed.data(), packed.size(), indexData, indices.size(), indexType);
+        }
+        else
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            layout = &vertexLayout();
+            vertexBufferBytes = vertices.size() * sizeof(Vertex);
+            range = rg::GeometryArena::instance().allocate(*layout, vertices.data(), vertices.size(), indexData, indices.size(), indexType);
+        }
+        ranges.assign(1, range);
+        VAO = range.vao;
+    }
+
+    // indices are relative to the mesh's base vertex, so most meshes fit in 16 bits. Converts `source` into `shortIndices`
+    // and points `data` at them when they do.
+    GLenum shortIndexType(const vector<unsigned int> &source, vector<unsigned short> &shortIndices, const void *&data) const
+    {
+        if(vertexCount > 65536)
+            return GL_UNSIGNED_INT;
+        shortIndices.assign(source.begin(), source.end());
+        data = shortIndices.data();
+        return GL_UNSIGNED_SHORT;
+    }
+
+    static const rg::VertexLayout& vertexLayout()
+    {
+        static const rg::VertexLayout layout = { sizeof(Vertex), setupVertexAttributes };
+        return layout;
+    }
+
+    static const rg::VertexLayout& packedLayout()
+    {
+        static const rg::VertexLayout layout = { sizeof(PackedVertex), setupPackedVertexAttributes };
+        return layout;
+    }
+
+    static void setupVertexAttributes()
+    {
         // set the vertex attribute pointers
         // vertex Positions
         glEnableVertexAttribArray(0);	
@@ -127,8 +385,51 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    }
+
+    // points the attributes at the normalized / half float fields of PackedVertex
+    static void setupPackedVertexAttributes()
+    {
+        // vertex Positions and bitangent sign
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // vertex tangent, the bitangent attribute stays disabled
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+    }
+
+    // quantizes the vertices into PackedVertex, positions relative to the mesh bounds
+    vector<PackedVertex> packVertices()
+    {
+        positionOffset = minimum;
+        positionScale = maximum - minimum;
 
-        glBindVertexArray(0);
+        vector<PackedVertex> packed(vertices.size());
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &vertex = vertices[i];
+            PackedVertex &out = packed[i];
+            for(int c = 0; c < 3; c++)
+                out.Position[c] = rg::packUnorm16(positionScale[c] > 0.0f ? (vertex.Position[c] - positionOffset[c]) / positionScale[c] : 0.0f);
+            bool rightHanded = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+            out.Position[3] = rightHanded ? 65535 : 0;
+
+            glm::vec2 normal = rg::octEncode(vertex.Normal);
+            out.Normal[0] = rg::packSnorm16(normal.x);
+            out.Normal[1] = rg::packSnorm16(normal.y);
+            glm::vec2 tangent = rg::octEncode(vertex.Tangent);
+            out.Tangent[0] = rg::packSnorm16(tangent.x);
+            out.Tangent[1] = rg::packSnorm16(tangent.y);
+            out.TexCoords[0] = rg::packHalf(vertex.TexCoords.x);
+            out.TexCoords[1] = rg::packHalf(vertex.TexCoords.y);
+        }
+        return packed;
     }
 };
 #endif
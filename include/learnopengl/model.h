@@ -11,7 +11,12 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
-#include <learnopengl/shader.h>
+#include <learnopengl/shader_m.h>
+#include <rg/LodSelector.h>
+#include <rg/MeshCache.h>
+#include <rg/MeshOptimizer.h>
+#include <rg/MeshSimplifier.h>
+#include <rg/TextureRegistry.h>
 
 #include <string>
 #include <fstream>
@@ -21,48 +26,268 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool normalMap = false);
 
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat; // layout the meshes are uploaded with
+    bool keepMeshData = false; // set before upload() to keep the CPU copy of vertices and indices (collision, picking)
+
+    // constructs an empty model, filled in later by import() and upload() (e.g. by rg::ModelLoader).
+    explicit Model(VertexFormat format = VertexFormat::Full, bool gamma = false) : gammaCorrection(gamma), vertexFormat(format)
+    {
+    }
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, VertexFormat format = VertexFormat::Full) : gammaCorrection(gamma), vertexFormat(format)
     {
-        loadModel(path);
+        import(path);
+        upload();
     }
 
-    // draws the model, and thus all its meshes
+    // the meshes hold one registry reference per material texture, copies would release them twice
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    // hands the material textures back to rg::TextureRegistry, which deletes the ones no other model uses
+    ~Model()
+    {
+        rg::TextureRegistry &registry = rg::TextureRegistry::instance();
+        for(const Mesh &mesh : meshes)
+            for(const Texture &texture : mesh.textures)
+                registry.release(texture.id);
+    }
+
+    // draws the model, and thus all its meshes, at full detail. They share the arena's VAO, so it is only bound once.
     void Draw(Shader &shader)
     {
+        DrawLod(shader, 0);
+    }
+
+    // draws the model with the level of detail rg::LodSelector picks for it at `model` (its model matrix).
+    // Every draw call of a frame keeps its own level, so a model drawn several times switches per instance.
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        glm::vec3 center;
+        DrawLod(shader, selectLod(model, center));
+    }
+
+    // like Draw(shader, model), but hands every mesh to `queue` instead of drawing right away
+    void Submit(rg::RenderQueue &queue, const Shader &shader, const glm::mat4 &model)
+    {
+        resolveTextures();
+        glm::vec3 center;
+        unsigned int level = selectLod(model, center);
+        for(const Mesh &mesh : meshes)
+            mesh.Submit(queue, shader, model, level, center);
+    }
+
+    // like Submit(queue, shader, model), only the meshes with a nonzero entry in `visible` (one per mesh) are handed over
+    void Submit(rg::RenderQueue &queue, const Shader &shader, const glm::mat4 &model, const unsigned char *visible)
+    {
+        resolveTextures();
+        // selected even when nothing is visible, so the instance keeps its level slot
+        glm::vec3 center;
+        unsigned int level = selectLod(model, center);
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            if(visible[i])
+                meshes[i].Submit(queue, shader, model, level, center);
+    }
+
+    // number of levels of detail of the model's most detailed mesh
+    unsigned int lodCount() const
+    {
+        unsigned int count = 1;
+        for(const Mesh &mesh : meshes)
+            count = std::max(count, mesh.lodCount());
+        return count;
+    }
+
+    // triangles drawn at each level of detail
+    vector<size_t> lodTriangleCounts() const
+    {
+        vector<size_t> counts(lodCount(), 0);
+        for(const Mesh &mesh : meshes)
+            for(unsigned int level = 0; level < counts.size(); level++)
+                counts[level] += mesh.triangleCount(level);
+        return counts;
+    }
+
+    // level the first instance was drawn with last
+    unsigned int currentLod() const
+    {
+        return lodLevels.empty() ? 0 : lodLevels[0];
     }
-    
+
+    // CPU half of loading: reads the model (or its cache entry) and processes it into mesh data.
+    // It touches no GL state, so it is safe to call from a worker thread.
+    void import(string const &path)
+    {
+        loadModel(path);
+    }
+
+    // GL half of loading: loads the referenced textures and creates the buffers of every imported mesh.
+    // Must be called on the thread that owns the GL context.
+    void upload()
+    {
+        meshes.reserve(meshes.size() + imported.size());
+        for(MeshData &data : imported)
+        {
+            vector<Texture> textures;
+            textures.reserve(data.textures.size());
+            for(const Texture &ref : data.textures)
+                textures.push_back(loadMaterialTexture(ref.path.c_str(), ref.type));
+
+            meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures), vertexFormat, keepMeshData);
+            for(const vector<unsigned int> &lod : data.lods)
+                meshes.back().addLod(lod);
+        }
+        vector<MeshData>().swap(imported);
+        computeBounds();
+    }
+
+    // bytes of mesh data still held in RAM
+    size_t cpuBytes() const
+    {
+        size_t bytes = 0;
+        for(const Mesh &mesh : meshes)
+            bytes += mesh.cpuBytes();
+        return bytes;
+    }
+
+    // bytes of vertex and index buffers, textures are shared between models and not included
+    size_t gpuBytes() const
+    {
+        size_t bytes = 0;
+        for(const Mesh &mesh : meshes)
+            bytes += mesh.gpuBytes();
+        return bytes;
+    }
+
 private:
+    vector<MeshData> imported; // meshes processed by import(), waiting for upload()
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    unsigned int lodFrame = 0;
+    unsigned int lodInstance = 0;
+    vector<unsigned int> lodLevels; // per draw call of the frame
+    unsigned int textureGeneration = 0; // rg::TextureRegistry::generation() the materials were resolved at
+
+    void DrawLod(Shader &shader, unsigned int level)
+    {
+        resolveTextures();
+        // meshes of one vertex format share a VAO, the state cache drops the repeated binds
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            rg::GLState::instance().bindVertexArray(meshes[i].VAO);
+            meshes[i].DrawRange(shader, level);
+        }
+    }
+
+    // follows the registry when it merged duplicate textures since the last draw
+    void resolveTextures()
+    {
+        const rg::TextureRegistry &registry = rg::TextureRegistry::instance();
+        if(textureGeneration == registry.generation())
+            return;
+        textureGeneration = registry.generation();
+        for(Mesh &mesh : meshes)
+            mesh.ResolveTextures();
+    }
+
+    // the level of detail for the next instance drawn this frame, `center` is set to its world space bounds center
+    unsigned int selectLod(const glm::mat4 &model, glm::vec3 &center)
+    {
+        rg::LodSelector &selector = rg::LodSelector::instance();
+        if(lodFrame != selector.frame())
+        {
+            lodFrame = selector.frame();
+            lodInstance = 0;
+        }
+        if(lodInstance == lodLevels.size())
+            lodLevels.push_back(0);
+
+        center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        unsigned int &level = lodLevels[lodInstance++];
+        level = selector.select(center, boundsRadius * scale, level, lodCount());
+        return level;
+    }
+
+    // bounding sphere around the mesh bounding boxes, used for level of detail selection
+    void computeBounds()
+    {
+        if(meshes.empty())
+            return;
+        glm::vec3 minimum = meshes[0].boundsMin(), maximum = meshes[0].boundsMax();
+        for(const Mesh &mesh : meshes)
+        {
+            minimum = glm::min(minimum, mesh.boundsMin());
+            maximum = glm::max(maximum, mesh.boundsMax());
+        }
+        boundsCenter = (minimum + maximum) * 0.5f;
+        boundsRadius = glm::length(maximum - minimum) * 0.5f;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // reuse the processed meshes from the previous run if the source hasn't changed
+        rg::MeshCache cache;
+        if(cache.open(path, importFlags))
+        {
+            loadCachedMeshes(cache);
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
+        imported.reserve(scene->mNumMeshes);
         processNode(scene->mRootNode, scene);
+
+        // weld, reorder and build the levels of detail once here, the cache stores the result
+        string name = path.substr(path.find_last_of('/') + 1);
+        for(unsigned int i = 0; i < imported.size(); i++)
+        {
+            rg::MeshOptimizer::optimize(imported[i], name + "[" + std::to_string(i) + "]");
+            rg::MeshSimplifier::buildLods(imported[i]);
+        }
+
+        rg::MeshCache::store(path, importFlags, imported);
+    }
+
+    // takes the processed meshes straight from a mapped cache entry, only the textures still have to be loaded
+    void loadCachedMeshes(const rg::MeshCache &cache)
+    {
+        imported.reserve(cache.meshes().size());
+        for(const rg::MeshCache::MeshView &view : cache.meshes())
+        {
+            MeshData data;
+            data.vertices.assign(view.vertices, view.vertices + view.vertexCount);
+            data.indices.assign(view.indices, view.indices + view.indexCount);
+            data.textures = view.textures;
+            for(const rg::MeshCache::IndexView &lod : view.lods)
+                data.lods.emplace_back(lod.indices, lod.indices + lod.indexCount);
+            imported.push_back(std::move(data));
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -74,7 +299,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -84,12 +309,14 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
-        // data to fill
+        // data to fill, sized up front so every array is built in place once
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -164,12 +391,16 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, its GL objects are created by upload()
+        MeshData data;
+        data.vertices = std::move(vertices);
+        data.indices = std::move(indices);
+        data.textures = std::move(textures);
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // collects all material textures of a given type. Only type and path are filled in,
+    // the textures themselves are loaded by upload() on the GL thread.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
@@ -177,72 +408,34 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
+
+    // returns the texture at the given material path. Textures are shared with every other model through
+    // rg::TextureRegistry, so an image is only loaded once no matter how many meshes or models reference it.
+    Texture loadMaterialTexture(const char *path, const string &typeName)
+    {
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory, gammaCorrection, typeName == "texture_normal");
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool normalMap)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // shared through the registry and loaded asynchronously, samples as a placeholder until it is uploaded
+    return rg::TextureRegistry::instance().acquire2D(filename, normalMap);
 }
 #endif
-
-
-
@@ -4,15 +4,44 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <rg/GLState.h>
+
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// FNV-1a hash of a uniform name. constexpr, so names known at compile time cost nothing at runtime
+constexpr uint64_t uniformNameHash(const char *name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; ++name)
+        hash = (hash ^ (unsigned char)*name) * 1099511628211ull;
+    return hash;
+}
 
 class Shader
 {
 public:
     unsigned int ID;
+    // a uniform name together with its hash, implicitly made from string literals and std::strings.
+    // static constexpr Shader::UniformName model("model"); hashes the name at compile time.
+    struct UniformName
+    {
+        uint64_t hash;
+        const char *name;
+        constexpr UniformName(const char *name) : hash(uniformNameHash(name)), name(name) {}
+        UniformName(const std::string &name) : hash(uniformNameHash(name.c_str())), name(name.c_str()) {}
+    };
+    // a location resolved once with uniform(), setting it is a plain glUniform call
+    struct Uniform
+    {
+        GLint location = -1;
+    };
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
@@ -65,6 +94,7 @@ public:
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        reflectUniforms();
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -74,68 +104,187 @@ public:
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        rg::GLState::instance().useProgram(ID);
+    }
+    // resolves the location of `name`, unknown names are reported once and give a handle that sets nothing
+    // ------------------------------------------------------------------------
+    Uniform uniform(UniformName name) const
+    {
+        Uniform uniform;
+        uniform.location = location(name);
+        return uniform;
+    }
+    // like uniform(), for names the program may legitimately lack: they are not reported
+    // ------------------------------------------------------------------------
+    Uniform findUniform(UniformName name) const
+    {
+        Uniform uniform;
+        auto it = locations.find(name.hash);
+        if (it != locations.end())
+            uniform.location = it->second;
+        return uniform;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformName name, bool value) const
+    {         
+        setBool(uniform(name), value);
+    }
+    void setBool(Uniform uniform, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(uniform.location, (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformName name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(uniform(name), value);
+    }
+    void setInt(Uniform uniform, int value) const
+    { 
+        glUniform1i(uniform.location, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformName name, float value) const
+    { 
+        setFloat(uniform(name), value);
+    }
+    void setFloat(Uniform uniform, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(uniform.location, value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformName name, const glm::vec2 &value) const
+    { 
+        setVec2(uniform(name), value);
+    }
+    void setVec2(Uniform uniform, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(uniform.location, 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformName name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(uniform(name), x, y);
+    }
+    void setVec2(Uniform uniform, float x, float y) const
+    { 
+        glUniform2f(uniform.location, x, y); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformName name, const glm::vec3 &value) const
+    { 
+        setVec3(uniform(name), value);
+    }
+    void setVec3(Uniform uniform, const glm::vec3 &value) const
+    { 
+        glUniform3fv(uniform.location, 1, &value[0]); 
+    }
+    void setVec3(UniformName name, float x, float y, float z) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(uniform(name), x, y, z);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(Uniform uniform, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(uniform.location, x, y, z); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformName name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(uniform(name), value);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    void setVec4(Uniform uniform, const glm::vec4 &value) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4fv(uniform.location, 1, &value[0]); 
+    }
+    void setVec4(UniformName name, float x, float y, float z, float w) const
+    { 
+        setVec4(uniform(name), x, y, z, w);
+    }
+    void setVec4(Uniform uniform, float x, float y, float z, float w) const
+    { 
+        glUniform4f(uniform.location, x, y, z, w); 
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(UniformName name, const glm::mat2 &mat) const
+    {
+        setMat2(uniform(name), mat);
+    }
+    void setMat2(Uniform uniform, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(UniformName name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
+    }
+    void setMat3(Uniform uniform, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(UniformName name, const glm::mat4 &mat) const
+    {
+        setMat4(uniform(name), mat);
+    }
+    void setMat4(Uniform uniform, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // locations of every active uniform by name hash, filled once after linking
+    std::unordered_map<uint64_t, GLint> locations;
+    // unknown names that were already reported
+    mutable std::unordered_set<uint64_t> unknownNames;
+
+    // table lookup of a name, no GL call
+    // ------------------------------------------------------------------------
+    GLint location(UniformName name) const
+    {
+        auto it = locations.find(name.hash);
+        if (it != locations.end())
+            return it->second;
+        if (unknownNames.insert(name.hash).second)
+            std::cout << "WARNING::SHADER::UNKNOWN_UNIFORM " << name.name << " in program " << ID << std::endl;
+        return -1;
+    }
+    // builds the location table from the program's active uniforms
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            // arrays of plain types are reported once as "name[0]", every element has its own location
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                addLocation(base, glGetUniformLocation(ID, name.c_str()));
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    addLocation(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                }
+            }
+            else
+                addLocation(name, glGetUniformLocation(ID, name.c_str()));
+        }
+    }
+    // ------------------------------------------------------------------------
+    void addLocation(const std::string &name, GLint location)
+    {
+        // members of uniform blocks have no location
+        if (location >= 0)
+            locations[uniformNameHash(name.c_str())] = location;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,356 @@
+#ifndef PROJECT_BASE_BLOCKCOMPRESSION_H
+#define PROJECT_BASE_BLOCKCOMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace rg {
+
+// CPU encoders for the BCn block formats we cache textures in. All of them work on 4x4 blocks of RGBA8 texels
+// and favour speed over quality: bounding box endpoints for BC1/BC4 and a principal axis fit for BC7 (mode 6 only).
+namespace bc {
+
+enum Format {
+    BC1,    // RGB, 8 bytes per block
+    BC3,    // RGBA (BC4 alpha + BC1 colour), 16 bytes per block
+    BC4,    // R, 8 bytes per block
+    BC5,    // RG (two BC4 blocks), 16 bytes per block
+    BC7     // RGBA, 16 bytes per block
+};
+
+inline unsigned int blockBytes(Format format) {
+    return format == BC1 || format == BC4 ? 8 : 16;
+}
+
+inline size_t compressedSize(Format format, int width, int height) {
+    return (size_t)std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * blockBytes(format);
+}
+
+// copies the 4x4 block at block coordinates (bx, by), replicating edge texels for images that aren't a multiple of 4
+inline void fetchBlock(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t block[16][4]) {
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            std::memcpy(block[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+inline uint16_t pack565(int r, int g, int b) {
+    return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+inline void unpack565(uint16_t c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 colour block, always in four colour mode so it can also serve as the colour half of BC3
+inline void encodeBC1(const uint8_t block[16][4], uint8_t out[8]) {
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], (int)block[i][c]);
+            hi[c] = std::max(hi[c], (int)block[i][c]);
+        }
+    }
+    // inset the box a little, the extremes are rarely hit exactly after quantization
+    for (int c = 0; c < 3; ++c) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    uint16_t c0 = pack565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = pack565(lo[0], lo[1], lo[2]);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = (int)block[i][c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+}
+
+// BC4 block of one channel, eight value mode
+inline void encodeBC4(const uint8_t block[16][4], int channel, uint8_t out[8]) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, (int)block[i][channel]);
+        hi = std::max(hi, (int)block[i][channel]);
+    }
+
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    uint64_t indices = 0;
+    if (hi != lo) {
+        int palette[8] = { hi, lo };
+        for (int p = 2; p < 8; ++p) {
+            palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; ++p) {
+                int error = std::abs((int)block[i][channel] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+}
+
+inline void encodeBC3(const uint8_t block[16][4], uint8_t out[16]) {
+    encodeBC4(block, 3, out);
+    encodeBC1(block, out + 8);
+}
+
+inline void encodeBC5(const uint8_t block[16][4], uint8_t out[16]) {
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+// BC7 mode 6: one subset, RGBA endpoints with 7 bits per channel plus a p-bit each, 4 bit indices
+inline void encodeBC7(const uint8_t block[16][4], uint8_t out[16]) {
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // principal axis of the block through power iteration on its covariance
+    float mean[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < 4; ++c) {
+            d[c] = block[i][c] - mean[c];
+        }
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                covariance[r][c] += d[r] * d[c];
+            }
+        }
+    }
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                next[r] += covariance[r][c] * axis[c];
+            }
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 4; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float tMin = 1e9f, tMax = -1e9f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            t += (block[i][c] - mean[c]) * axis[c];
+        }
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    // quantize both endpoints to 7 bits + p-bit, picking the p-bit that reproduces them best
+    int endpoint[2][4], pbit[2];
+    for (int e = 0; e < 2; ++e) {
+        float t = e == 0 ? tMin : tMax;
+        float target[4];
+        for (int c = 0; c < 4; ++c) {
+            target[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * t));
+        }
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; ++p) {
+            int q[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                q[c] = std::min(127, std::max(0, (int)std::lround((target[c] - p) / 2.0f)));
+                float d = (float)((q[c] << 1) | p) - target[c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                pbit[e] = p;
+                std::memcpy(endpoint[e], q, sizeof(q));
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+        int e0 = (endpoint[0][c] << 1) | pbit[0];
+        int e1 = (endpoint[1][c] << 1) | pbit[1];
+        for (int w = 0; w < 16; ++w) {
+            palette[w][c] = ((64 - weights[w]) * e0 + weights[w] * e1 + 32) >> 6;
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int w = 0; w < 16; ++w) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int d = (int)block[i][c] - palette[w][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the anchor index is stored with its top bit implied zero
+    if (indices[0] & 8) {
+        std::swap(endpoint[0], endpoint[1]);
+        std::swap(pbit[0], pbit[1]);
+        for (int i = 0; i < 16; ++i) {
+            indices[i] = 15 - indices[i];
+        }
+    }
+
+    std::memset(out, 0, 16);
+    unsigned int position = 0;
+    auto write = [&](unsigned int value, unsigned int bits) {
+        for (unsigned int b = 0; b < bits; ++b, ++position) {
+            out[position >> 3] |= ((value >> b) & 1) << (position & 7);
+        }
+    };
+    write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        write(endpoint[0][c], 7);
+        write(endpoint[1][c], 7);
+    }
+    write(pbit[0], 1);
+    write(pbit[1], 1);
+    write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        write(indices[i], 4);
+    }
+}
+
+inline void encodeBlock(Format format, const uint8_t block[16][4], uint8_t *out) {
+    switch (format) {
+        case BC1: encodeBC1(block, out); break;
+        case BC3: encodeBC3(block, out); break;
+        case BC4: encodeBC4(block, 0, out); break;
+        case BC5: encodeBC5(block, out); break;
+        case BC7: encodeBC7(block, out); break;
+    }
+}
+
+// compresses one RGBA8 image, appending the blocks to `out`
+inline void encodeImage(Format format, const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out) {
+    int blocksX = std::max(1, (width + 3) / 4), blocksY = std::max(1, (height + 3) / 4);
+    size_t offset = out.size();
+    out.resize(offset + compressedSize(format, width, height));
+    uint8_t block[16][4];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            fetchBlock(rgba, width, height, bx, by, block);
+            encodeBlock(format, block, &out[offset]);
+            offset += blockBytes(format);
+        }
+    }
+}
+
+// 2x2 box filter down to the next mip level, odd edges are clamped
+inline std::vector<uint8_t> downsample(const uint8_t *rgba, int width, int height) {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<uint8_t> result((size_t)w * h * 4);
+    for (int y = 0; y < h; ++y) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < w; ++x) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+                        + rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+                result[((size_t)y * w + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// bilinear scale to size x size, texel centres of the source and destination line up, edges wrap like GL_REPEAT
+inline std::vector<uint8_t> resample(const uint8_t *rgba, int width, int height, int size) {
+    std::vector<uint8_t> result((size_t)size * size * 4);
+    for (int y = 0; y < size; ++y) {
+        float sy = ((float)y + 0.5f) * (float)height / (float)size - 0.5f;
+        int y0 = (int)std::floor(sy);
+        float fy = sy - (float)y0;
+        int rows[2] = { (y0 + height) % height, (y0 + 1) % height };
+        for (int x = 0; x < size; ++x) {
+            float sx = ((float)x + 0.5f) * (float)width / (float)size - 0.5f;
+            int x0 = (int)std::floor(sx);
+            float fx = sx - (float)x0;
+            int columns[2] = { (x0 + width) % width, (x0 + 1) % width };
+            for (int c = 0; c < 4; ++c) {
+                float top = rgba[((size_t)rows[0] * width + columns[0]) * 4 + c] * (1.0f - fx)
+                            + rgba[((size_t)rows[0] * width + columns[1]) * 4 + c] * fx;
+                float bottom = rgba[((size_t)rows[1] * width + columns[0]) * 4 + c] * (1.0f - fx)
+                               + rgba[((size_t)rows[1] * width + columns[1]) * 4 + c] * fx;
+                result[((size_t)y * size + x) * 4 + c] = (uint8_t)(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return result;
+}
+
+}
+
+}
+
+#endif //PROJECT_BASE_BLOCKCOMPRESSION_H
@@ -0,0 +1,377 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Frustum.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Bounding volume hierarchy over axis aligned boxes ("items", numbered in the order they were passed to build()).
+// Built top-down with the surface area heuristic evaluated over BinCount bins per axis, stored as one flat array of
+// 32 byte nodes with both children of a node next to each other, so queries walk contiguous memory. Queries
+// answer with item numbers: everything inside a frustum, everything overlapping a box, the nearest box along a ray.
+//
+// Meant for a scene that mostly stands still: update() moves one item and refits the boxes from its leaf up to the
+// root without changing the tree, which is cheap but degrades it if items move far. Rebuild when many have.
+class Bvh {
+public:
+    static const unsigned int BinCount = 12;
+    static const unsigned int MaxLeafItems = 4;
+    // deeper nodes become leaves whatever their size, which bounds the traversal stacks
+    static const unsigned int MaxDepth = 48;
+
+    struct Hit {
+        unsigned int item = 0;
+        float distance = 0.0f; // along the ray, in units of its direction's length
+    };
+
+    void build(const std::vector<glm::vec3> &minimums, const std::vector<glm::vec3> &maximums) {
+        m_Minimums = minimums;
+        m_Maximums = maximums;
+        unsigned int count = (unsigned int)minimums.size();
+        m_Items.resize(count);
+        for (unsigned int i = 0; i < count; ++i) {
+            m_Items[i] = i;
+        }
+        m_Nodes.clear();
+        m_Parents.clear();
+        m_Leaves.assign(count, 0);
+        if (count == 0) {
+            return;
+        }
+        m_Nodes.reserve(2 * count);
+        m_Parents.reserve(2 * count);
+
+        std::vector<glm::vec3> centers(count);
+        for (unsigned int i = 0; i < count; ++i) {
+            centers[i] = (minimums[i] + maximums[i]) * 0.5f;
+        }
+        addNode(-1, 0, count);
+        std::vector<std::pair<unsigned int, unsigned int>> stack(1, std::make_pair(0u, 0u)); // node, depth
+        while (!stack.empty()) {
+            unsigned int index = stack.back().first, depth = stack.back().second;
+            stack.pop_back();
+            unsigned int middle;
+            if (depth >= MaxDepth || !split(m_Nodes[index], centers, middle)) {
+                for (unsigned int i = m_Nodes[index].first; i < m_Nodes[index].first + m_Nodes[index].count; ++i) {
+                    m_Leaves[m_Items[i]] = index;
+                }
+                continue;
+            }
+            Node node = m_Nodes[index];
+            unsigned int left = addNode((int)index, node.first, middle - node.first);
+            addNode((int)index, middle, node.first + node.count - middle);
+            m_Nodes[index].first = left;
+            m_Nodes[index].count = 0;
+            stack.push_back(std::make_pair(left + 1, depth + 1));
+            stack.push_back(std::make_pair(left, depth + 1));
+        }
+    }
+
+    // moves item `item` to [minimum, maximum] and refits the nodes above it
+    void update(unsigned int item, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        m_Minimums[item] = minimum;
+        m_Maximums[item] = maximum;
+        if (m_Nodes.empty()) {
+            return;
+        }
+        int index = (int)m_Leaves[item];
+        fitLeaf(m_Nodes[index]);
+        for (index = m_Parents[index]; index >= 0; index = m_Parents[index]) {
+            Node &node = m_Nodes[index];
+            const Node &left = m_Nodes[node.first], &right = m_Nodes[node.first + 1];
+            node.minimum = glm::min(left.minimum, right.minimum);
+            node.maximum = glm::max(left.maximum, right.maximum);
+        }
+    }
+
+    // appends every item at least partly inside `frustum` to `items`, returns the number of nodes visited
+    unsigned int query(const Frustum &frustum, std::vector<unsigned int> &items) const {
+        unsigned int visited = 0;
+        unsigned int stack[MaxDepth + 2];
+        unsigned int size = 0;
+        if (!m_Nodes.empty()) {
+            stack[size++] = 0;
+        }
+        while (size > 0) {
+            const Node &node = m_Nodes[stack[--size]];
+            ++visited;
+            Frustum::Containment containment = frustum.classify((node.minimum + node.maximum) * 0.5f,
+                                                                (node.maximum - node.minimum) * 0.5f);
+            if (containment == Frustum::Outside) {
+                continue;
+            }
+            if (containment == Frustum::Inside) {
+                collect(node, items);
+            } else if (node.count > 0) {
+                for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+                    unsigned int item = m_Items[i];
+                    if (frustum.intersects((m_Minimums[item] + m_Maximums[item]) * 0.5f,
+                                           (m_Maximums[item] - m_Minimums[item]) * 0.5f)) {
+                        items.push_back(item);
+                    }
+                }
+            } else {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+            }
+        }
+        return visited;
+    }
+
+    // appends every item whose box overlaps [minimum, maximum] to `items`
+    void query(const glm::vec3 &minimum, const glm::vec3 &maximum, std::vector<unsigned int> &items) const {
+        unsigned int stack[MaxDepth + 2];
+        unsigned int size = 0;
+        if (!m_Nodes.empty()) {
+            stack[size++] = 0;
+        }
+        while (size > 0) {
+            const Node &node = m_Nodes[stack[--size]];
+            if (!overlaps(node.minimum, node.maximum, minimum, maximum)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+                    unsigned int item = m_Items[i];
+                    if (overlaps(m_Minimums[item], m_Maximums[item], minimum, maximum)) {
+                        items.push_back(item);
+                    }
+                }
+            } else {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+            }
+        }
+    }
+
+    // the item whose box the ray from `origin` along `direction` enters first, within `maxDistance`.
+    // A ray starting inside a box hits it at distance 0.
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit &hit) const {
+        glm::vec3 inverse = glm::vec3(1.0f) / direction;
+        float nearest = maxDistance;
+        bool found = false;
+        unsigned int stack[MaxDepth + 2];
+        unsigned int size = 0;
+        float enter;
+        if (!m_Nodes.empty() && slab(m_Nodes[0].minimum, m_Nodes[0].maximum, origin, inverse, nearest, enter)) {
+            stack[size++] = 0;
+        }
+        while (size > 0) {
+            const Node &node = m_Nodes[stack[--size]];
+            // a closer hit may have been found since the node was pushed
+            if (!slab(node.minimum, node.maximum, origin, inverse, nearest, enter)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+                    unsigned int item = m_Items[i];
+                    if (slab(m_Minimums[item], m_Maximums[item], origin, inverse, nearest, enter)) {
+                        nearest = enter;
+                        hit.item = item;
+                        hit.distance = enter;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            // the nearer child is visited first, it is the likelier to shorten the ray
+            float left, right;
+            bool hitLeft = slab(m_Nodes[node.first].minimum, m_Nodes[node.first].maximum, origin, inverse, nearest, left);
+            bool hitRight = slab(m_Nodes[node.first + 1].minimum, m_Nodes[node.first + 1].maximum, origin, inverse, nearest, right);
+            if (hitLeft && hitRight) {
+                stack[size++] = left <= right ? node.first + 1 : node.first;
+                stack[size++] = left <= right ? node.first : node.first + 1;
+            } else if (hitLeft || hitRight) {
+                stack[size++] = hitLeft ? node.first : node.first + 1;
+            }
+        }
+        return found;
+    }
+
+    unsigned int itemCount() const {
+        return (unsigned int)m_Items.size();
+    }
+
+    unsigned int nodeCount() const {
+        return (unsigned int)m_Nodes.size();
+    }
+
+    const glm::vec3& minimum(unsigned int item) const {
+        return m_Minimums[item];
+    }
+
+    const glm::vec3& maximum(unsigned int item) const {
+        return m_Maximums[item];
+    }
+
+private:
+    // a leaf if count > 0, holding m_Items[first, first + count), else its children are nodes first and first + 1
+    struct Node {
+        glm::vec3 minimum;
+        unsigned int first;
+        glm::vec3 maximum;
+        unsigned int count;
+    };
+
+    std::vector<Node> m_Nodes;
+    std::vector<int> m_Parents; // per node, -1 for the root
+    std::vector<unsigned int> m_Items; // leaves' items, contiguous per leaf
+    std::vector<unsigned int> m_Leaves; // per item, the leaf holding it
+    std::vector<glm::vec3> m_Minimums; // per item
+    std::vector<glm::vec3> m_Maximums;
+
+    unsigned int addNode(int parent, unsigned int first, unsigned int count) {
+        Node node;
+        node.first = first;
+        node.count = count;
+        fitLeaf(node);
+        m_Nodes.push_back(node);
+        m_Parents.push_back(parent);
+        return (unsigned int)m_Nodes.size() - 1;
+    }
+
+    void fitLeaf(Node &node) const {
+        node.minimum = glm::vec3(std::numeric_limits<float>::max());
+        node.maximum = glm::vec3(-std::numeric_limits<float>::max());
+        for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+            node.minimum = glm::min(node.minimum, m_Minimums[m_Items[i]]);
+            node.maximum = glm::max(node.maximum, m_Maximums[m_Items[i]]);
+        }
+    }
+
+    static float area(const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        glm::vec3 size = glm::max(maximum - minimum, glm::vec3(0.0f));
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    // partitions the node's items at `middle` if that is cheaper than keeping them in one leaf
+    bool split(const Node &node, const std::vector<glm::vec3> &centers, unsigned int &middle) {
+        if (node.count <= 1) {
+            return false;
+        }
+        glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+        for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+            low = glm::min(low, centers[m_Items[i]]);
+            high = glm::max(high, centers[m_Items[i]]);
+        }
+
+        // cost in item tests, a node visit counts as one
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        float parentArea = std::max(area(node.minimum, node.maximum), 1e-12f);
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = high[axis] - low[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            unsigned int counts[BinCount] = {};
+            glm::vec3 binMin[BinCount], binMax[BinCount];
+            std::fill_n(binMin, BinCount, glm::vec3(std::numeric_limits<float>::max()));
+            std::fill_n(binMax, BinCount, glm::vec3(-std::numeric_limits<float>::max()));
+            for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+                unsigned int item = m_Items[i];
+                unsigned int bin = binOf(centers[item][axis], low[axis], extent);
+                ++counts[bin];
+                binMin[bin] = glm::min(binMin[bin], m_Minimums[item]);
+                binMax[bin] = glm::max(binMax[bin], m_Maximums[item]);
+            }
+
+            // areas and counts left of every plane between bins, then sweep back from the right
+            float leftArea[BinCount - 1];
+            unsigned int leftCount[BinCount - 1];
+            glm::vec3 sweepMin(std::numeric_limits<float>::max()), sweepMax(-std::numeric_limits<float>::max());
+            unsigned int sweepCount = 0;
+            for (unsigned int plane = 0; plane < BinCount - 1; ++plane) {
+                sweepCount += counts[plane];
+                sweepMin = glm::min(sweepMin, binMin[plane]);
+                sweepMax = glm::max(sweepMax, binMax[plane]);
+                leftCount[plane] = sweepCount;
+                leftArea[plane] = area(sweepMin, sweepMax);
+            }
+            sweepMin = glm::vec3(std::numeric_limits<float>::max());
+            sweepMax = glm::vec3(-std::numeric_limits<float>::max());
+            sweepCount = 0;
+            for (unsigned int plane = BinCount - 1; plane-- > 0;) {
+                sweepCount += counts[plane + 1];
+                sweepMin = glm::min(sweepMin, binMin[plane + 1]);
+                sweepMax = glm::max(sweepMax, binMax[plane + 1]);
+                if (leftCount[plane] == 0 || sweepCount == 0) {
+                    continue;
+                }
+                float cost = 1.0f + (leftArea[plane] * leftCount[plane] + area(sweepMin, sweepMax) * sweepCount) / parentArea;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = plane;
+                }
+            }
+        }
+
+        if (bestAxis < 0) {
+            // every center in one spot, only the leaf size limit forces a split
+            if (node.count <= MaxLeafItems) {
+                return false;
+            }
+            middle = node.first + node.count / 2;
+            return true;
+        }
+        if (bestCost >= (float)node.count && node.count <= MaxLeafItems) {
+            return false;
+        }
+        float extent = high[bestAxis] - low[bestAxis];
+        auto end = m_Items.begin() + node.first + node.count;
+        auto it = std::partition(m_Items.begin() + node.first, end, [&](unsigned int item) {
+            return binOf(centers[item][bestAxis], low[bestAxis], extent) <= bestBin;
+        });
+        middle = (unsigned int)(it - m_Items.begin());
+        return true;
+    }
+
+    static unsigned int binOf(float center, float low, float extent) {
+        unsigned int bin = (unsigned int)((center - low) / extent * BinCount);
+        return std::min(bin, BinCount - 1);
+    }
+
+    void collect(const Node &root, std::vector<unsigned int> &items) const {
+        unsigned int stack[MaxDepth + 2];
+        unsigned int size = 0;
+        stack[size++] = (unsigned int)(&root - m_Nodes.data());
+        while (size > 0) {
+            const Node &node = m_Nodes[stack[--size]];
+            if (node.count > 0) {
+                items.insert(items.end(), m_Items.begin() + node.first, m_Items.begin() + node.first + node.count);
+            } else {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+            }
+        }
+    }
+
+    static bool overlaps(const glm::vec3 &minA, const glm::vec3 &maxA, const glm::vec3 &minB, const glm::vec3 &maxB) {
+        return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y
+               && minA.z <= maxB.z && maxA.z >= minB.z;
+    }
+
+    // whether the ray enters the box before `limit`, `enter` is set to where it does
+    static bool slab(const glm::vec3 &minimum, const glm::vec3 &maximum, const glm::vec3 &origin,
+                     const glm::vec3 &inverse, float limit, float &enter) {
+        glm::vec3 t0 = (minimum - origin) * inverse, t1 = (maximum - origin) * inverse;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, limit));
+        return enter <= exit;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_BVH_H
@@ -9,6 +9,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <rg/Frustum.h>
+
 #include <vector>
 
 enum Camera_Movement {
@@ -55,10 +57,15 @@ public:
         updateCameraVectors();
     }
 
-    glm::mat4 GetViewMatrix() {
+    glm::mat4 GetViewMatrix() const {
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // the planes of what `projection` sees from the camera; pass the projection the frame is drawn with
+    rg::Frustum GetFrustum(const glm::mat4 &projection) const {
+        return rg::Frustum::fromMatrix(projection * GetViewMatrix());
+    }
+
     void ProcessKeyboard(Camera_Movement direction, float deltaTime) {
         float velocity = MovementSpeed * deltaTime;
         if (direction == FORWARD) {
@@ -0,0 +1,81 @@
+#ifndef PROJECT_BASE_CAMERABUFFER_H
+#define PROJECT_BASE_CAMERABUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/StreamBuffer.h>
+
+namespace rg {
+
+// Per-frame camera state as one std140 uniform block, written to the StreamBuffer every frame and bound to a fixed
+// binding point that every program's Camera block is attached to. Shaders declare it as
+//
+//     layout (std140) uniform Camera {
+//         mat4 view;
+//         mat4 projection;
+//         mat4 viewProjection;
+//         vec4 cameraPosition;
+//         float time;
+//     };
+//
+// so per draw only the model matrix has to be set. GL thread only.
+class CameraBuffer {
+public:
+    static const unsigned int Binding = 0;
+
+    // mirrors the std140 layout of the Camera block
+    struct Data {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 viewProjection;
+        glm::vec4 cameraPosition; // w unused
+        float time;
+        float padding[3];
+    };
+
+    static CameraBuffer& instance() {
+        static CameraBuffer buffer;
+        return buffer;
+    }
+
+    CameraBuffer(const CameraBuffer&) = delete;
+    CameraBuffer& operator=(const CameraBuffer&) = delete;
+
+    // points the Camera block of `program` (if it has one) at the shared buffer, call once after linking.
+    // GLSL 3.30 has no layout(binding = N) for blocks, so it is done here.
+    static void attach(unsigned int program) {
+        unsigned int block = glGetUniformBlockIndex(program, "Camera");
+        if (block != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, block, Binding);
+        }
+    }
+
+    // uploads this frame's camera, once per frame after StreamBuffer::beginFrame and before anything is drawn
+    void update(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition, float time) {
+        m_Data.view = view;
+        m_Data.projection = projection;
+        m_Data.viewProjection = projection * view;
+        m_Data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+        m_Data.time = time;
+
+        StreamBuffer &stream = StreamBuffer::instance();
+        StreamBuffer::Allocation allocation = stream.write(&m_Data, sizeof(Data), stream.uniformAlignment());
+        if (allocation.valid()) {
+            GLState::instance().bindBufferRange(GL_UNIFORM_BUFFER, Binding, allocation.buffer, allocation.offset, allocation.size);
+        }
+    }
+
+    const Data& data() const {
+        return m_Data;
+    }
+
+private:
+    Data m_Data;
+
+    CameraBuffer() = default;
+};
+
+}
+
+#endif //PROJECT_BASE_CAMERABUFFER_H
@@ -0,0 +1,103 @@
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+namespace rg {
+
+// The six planes bounding what a view-projection matrix sees, in world space. Every plane is (normal, w) with the
+// normal pointing inside and normalized, so dot(normal, p) + w is the signed distance of p from the plane.
+struct Frustum {
+    enum Plane {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        PlaneCount
+    };
+
+    glm::vec4 planes[PlaneCount];
+
+    // Gribb and Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    static Frustum fromMatrix(const glm::mat4 &viewProjection) {
+        const glm::mat4 &m = viewProjection;
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; ++row) {
+            rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+        }
+
+        Frustum frustum;
+        frustum.planes[Left] = rows[3] + rows[0];
+        frustum.planes[Right] = rows[3] - rows[0];
+        frustum.planes[Bottom] = rows[3] + rows[1];
+        frustum.planes[Top] = rows[3] - rows[1];
+        frustum.planes[Near] = rows[3] + rows[2];
+        frustum.planes[Far] = rows[3] - rows[2];
+        for (glm::vec4 &plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    // the part of the frustum seen through the screen rectangle [left, right] x [bottom, top] in normalized device
+    // coordinates: the side planes move in to x = left * w, x = right * w and so on
+    static Frustum fromMatrix(const glm::mat4 &viewProjection, float left, float right, float bottom, float top) {
+        const glm::mat4 &m = viewProjection;
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; ++row) {
+            rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+        }
+
+        Frustum frustum = fromMatrix(viewProjection);
+        frustum.planes[Left] = rows[0] - left * rows[3];
+        frustum.planes[Right] = right * rows[3] - rows[0];
+        frustum.planes[Bottom] = rows[1] - bottom * rows[3];
+        frustum.planes[Top] = top * rows[3] - rows[1];
+        for (int plane = Left; plane <= Top; ++plane) {
+            frustum.planes[plane] /= glm::length(glm::vec3(frustum.planes[plane]));
+        }
+        return frustum;
+    }
+
+    enum Containment {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    // where the box around `center` reaching `extent` along each axis lies
+    Containment classify(const glm::vec3 &center, const glm::vec3 &extent) const {
+        Containment containment = Inside;
+        for (const glm::vec4 &plane : planes) {
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (distance + radius < 0.0f) {
+                return Outside;
+            }
+            if (distance - radius < 0.0f) {
+                containment = Intersecting;
+            }
+        }
+        return containment;
+    }
+
+    // whether the box around `center` reaching `extent` along each axis is at least partly inside
+    bool intersects(const glm::vec3 &center, const glm::vec3 &extent) const {
+        for (const glm::vec4 &plane : planes) {
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if (distance + radius < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRUSTUM_H
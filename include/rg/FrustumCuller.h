@@ -0,0 +1,221 @@
+#ifndef PROJECT_BASE_FRUSTUMCULLER_H
+#define PROJECT_BASE_FRUSTUMCULLER_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bvh.h>
+#include <rg/Frustum.h>
+#include <rg/Portals.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PROJECT_BASE_FRUSTUMCULLER_SSE 1
+#endif
+
+#include <cmath>
+#include <vector>
+
+namespace rg {
+
+// World space axis aligned boxes as center and half extent, one array per component so FrustumCuller can test
+// four of them per instruction. The arrays are zero padded to a multiple of four.
+class BoundingBoxes {
+public:
+    void resize(unsigned int count) {
+        m_Count = count;
+        unsigned int padded = (count + 3) & ~3u;
+        for (std::vector<float> &component : m_Components) {
+            component.resize(padded, 0.0f);
+        }
+    }
+
+    unsigned int add(const glm::vec3 &center, const glm::vec3 &extent) {
+        unsigned int index = m_Count;
+        resize(m_Count + 1);
+        set(index, center, extent);
+        return index;
+    }
+
+    void set(unsigned int index, const glm::vec3 &center, const glm::vec3 &extent) {
+        m_Components[0][index] = center.x;
+        m_Components[1][index] = center.y;
+        m_Components[2][index] = center.z;
+        m_Components[3][index] = extent.x;
+        m_Components[4][index] = extent.y;
+        m_Components[5][index] = extent.z;
+    }
+
+    // the box around the object space box [minimum, maximum] after transforming it by `model`
+    void set(unsigned int index, const glm::mat4 &model, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        glm::vec3 center = glm::vec3(model * glm::vec4((minimum + maximum) * 0.5f, 1.0f));
+        glm::vec3 halfSize = (maximum - minimum) * 0.5f;
+        glm::vec3 extent(0.0f);
+        for (int column = 0; column < 3; ++column) {
+            extent += glm::abs(glm::vec3(model[column])) * halfSize[column];
+        }
+        set(index, center, extent);
+    }
+
+    unsigned int size() const {
+        return m_Count;
+    }
+
+    glm::vec3 minimum(unsigned int index) const {
+        return center(index) - extent(index);
+    }
+
+    glm::vec3 maximum(unsigned int index) const {
+        return center(index) + extent(index);
+    }
+
+    glm::vec3 center(unsigned int index) const {
+        return glm::vec3(m_Components[0][index], m_Components[1][index], m_Components[2][index]);
+    }
+
+    glm::vec3 extent(unsigned int index) const {
+        return glm::vec3(m_Components[3][index], m_Components[4][index], m_Components[5][index]);
+    }
+
+private:
+    friend class FrustumCuller;
+
+    unsigned int m_Count = 0;
+    std::vector<float> m_Components[6]; // center x, y, z, extent x, y, z
+};
+
+// Tests bounding boxes against the camera frustum before anything is submitted, either all of them four at a time
+// with SSE (plain floats on targets without it), or through a Bvh over them, which only looks at the boxes in nodes
+// the frustum reaches. A box is culled once it lies entirely behind one of the planes. Boxes crossing a corner
+// outside the frustum are kept, which is conservative. With Portals set, boxes inside the frustum are also culled
+// if none of their cells are seen through a portal. beginFrame() must be called once per frame before the first
+// cull().
+class FrustumCuller {
+public:
+    struct Stats {
+        unsigned int tested = 0; // boxes, whether tested one by one or skipped with their Bvh node
+        unsigned int visible = 0;
+        unsigned int nodesVisited = 0; // Bvh nodes
+        unsigned int portalCulled = 0; // inside the frustum, but hidden behind the portals
+
+        unsigned int culled() const {
+            return tested - visible;
+        }
+    };
+
+    // when off every box is visible, to compare against
+    bool enabled = true;
+
+    static FrustumCuller& instance() {
+        static FrustumCuller culler;
+        return culler;
+    }
+
+    FrustumCuller(const FrustumCuller&) = delete;
+    FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+    // nullptr for none; `portals` must have had its beginFrame() this frame
+    void setPortals(const Portals *portals) {
+        m_Portals = portals;
+    }
+
+    void beginFrame(const Frustum &frustum) {
+        m_Frustum = frustum;
+        m_Stats = Stats();
+    }
+
+    // visible[i] is set to 1 if box i is at least partly inside the frustum, else 0
+    void cull(const BoundingBoxes &boxes, std::vector<unsigned char> &visible) {
+        unsigned int count = boxes.size();
+        visible.resize(count);
+        m_Stats.tested += count;
+        if (!enabled) {
+            visible.assign(count, 1);
+            m_Stats.visible += count;
+            return;
+        }
+
+        const float *cx = boxes.m_Components[0].data(), *cy = boxes.m_Components[1].data(), *cz = boxes.m_Components[2].data();
+        const float *ex = boxes.m_Components[3].data(), *ey = boxes.m_Components[4].data(), *ez = boxes.m_Components[5].data();
+        unsigned int i = 0;
+#ifdef PROJECT_BASE_FRUSTUMCULLER_SSE
+        // the padding makes the last group of four safe to load
+        for (; i < count; i += 4) {
+            __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+            __m128 sx = _mm_loadu_ps(ex + i), sy = _mm_loadu_ps(ey + i), sz = _mm_loadu_ps(ez + i);
+            __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all lanes set
+            for (const glm::vec4 &plane : m_Frustum.planes) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), sx),
+                                                      _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), sy)),
+                                           _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), sz));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (unsigned int lane = 0; lane < 4 && i + lane < count; ++lane) {
+                visible[i + lane] = (unsigned char)((mask >> lane) & 1);
+                m_Stats.visible += (mask >> lane) & 1;
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            bool inside = m_Frustum.intersects(glm::vec3(cx[i], cy[i], cz[i]), glm::vec3(ex[i], ey[i], ez[i]));
+            visible[i] = inside ? 1 : 0;
+            m_Stats.visible += inside ? 1 : 0;
+        }
+        if (m_Portals && m_Portals->enabled) {
+            for (i = 0; i < count; ++i) {
+                if (visible[i] && !m_Portals->visible(boxes.center(i), boxes.extent(i))) {
+                    visible[i] = 0;
+                    --m_Stats.visible;
+                    ++m_Stats.portalCulled;
+                }
+            }
+        }
+    }
+
+    // visible[i] is set for item i of `bvh` like for box i above
+    void cull(const Bvh &bvh, std::vector<unsigned char> &visible) {
+        unsigned int count = bvh.itemCount();
+        m_Stats.tested += count;
+        if (!enabled) {
+            visible.assign(count, 1);
+            m_Stats.visible += count;
+            return;
+        }
+        visible.assign(count, 0);
+        m_Found.clear();
+        m_Stats.nodesVisited += bvh.query(m_Frustum, m_Found);
+        bool portals = m_Portals && m_Portals->enabled;
+        for (unsigned int item : m_Found) {
+            if (portals && !m_Portals->visible((bvh.minimum(item) + bvh.maximum(item)) * 0.5f,
+                                               (bvh.maximum(item) - bvh.minimum(item)) * 0.5f)) {
+                ++m_Stats.portalCulled;
+                continue;
+            }
+            visible[item] = 1;
+            ++m_Stats.visible;
+        }
+    }
+
+    const Frustum& frustum() const {
+        return m_Frustum;
+    }
+
+    // counts of the frame in progress, complete once everything was submitted
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+private:
+    Frustum m_Frustum = Frustum();
+    Stats m_Stats;
+    const Portals *m_Portals = nullptr;
+    std::vector<unsigned int> m_Found;
+
+    FrustumCuller() = default;
+};
+
+}
+
+#endif //PROJECT_BASE_FRUSTUMCULLER_H
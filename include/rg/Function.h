@@ -6,6 +6,9 @@
 #define PROJECT_BASE_FUNCTION_H
 
 #include <learnopengl/model.h>
+#include <rg/InstanceBatch.h>
+#include <rg/StaticGeometry.h>
+#include <rg/VoxelGrid.h>
 
 class Function {
 public:
@@ -27,7 +30,8 @@ public:
         return false;
     }
 
-    void settingUpElevatorDoor(Shader &shader, glm::mat4 &model, glm::vec3& position, bool open, float i, int start) {
+    void settingUpElevatorDoor(Shader &shader, glm::mat4 &model, glm::vec3& position, bool open, float i, int start,
+                               unsigned int cubeVAO, unsigned int glass) {
         model = glm::mat4(1.0f);
         if (start == 1) {
             model = glm::translate(model, glm::vec3(position.x, position.y = position.y + ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i >= 8.32f ?
@@ -50,124 +54,33 @@ public:
                                                                                                                ((float)glfwGetTime() * i)));
         }
         model = glm::scale(model, glm::vec3(0.05f, 3.6f, 1.3f));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-    }
-    void loadElevator(Model &elevatorModel, glm::mat4 &model, Shader &shader, glm::vec3 &position, float i, int start) {
+        rg::RenderQueue::Item door;
+        door.shader = &shader;
+        door.vao = cubeVAO;
+        door.textures[0] = glass;
+        door.model = model;
+        door.draw = rg::RenderQueue::drawArrays;
+        door.count = 36;
+        rg::RenderQueue::instance().submit(rg::RenderQueue::Opaque, door, glm::vec3(model[3]));
+    }
+    // advances the elevator along its shaft, the scene node follows `position`
+    void moveElevator(glm::vec3 &position, float i, int start) {
         if (start == 1) {
-            model = glm::translate(model, glm::vec3(position.x, position.y = position.y + ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i >= 0.0f ?
-                                                                 0.0f : position.y + ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i,
-                                                    position.z));
+            position.y = position.y + ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i >= 0.0f ?
+                         0.0f : position.y + ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i;
         }
         else if (start == 0) {
-            model = glm::translate(model, glm::vec3(position.x, position.y = position.y - ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i <= -6.0f ?
-                                                                                           -6.0f : position.y - ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i,
-                                                                  position.z));
-
+            position.y = position.y - ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i <= -6.0f ?
+                         -6.0f : position.y - ((float)glfwGetTime() * i) - (-9.81 / 2.0f) * i * i;
         }
-        else {
-            model = glm::translate(model, glm::vec3(position.x, position.y, position.z));
-        }
-
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.15f, 0.1f));
-        shader.setMat4("model", model);
-        elevatorModel.Draw(shader);
-    }
-
-    void loadSecondBedsideTable(Model &bedsideModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(0.7f, 6.0f, 3.8f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.0002f));
-        shader.setMat4("model", model);
-        bedsideModel.Draw(shader);
-    }
-
-    void loadFirstBedsideTable(Model &bedsideModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(6.7f, 6.0f, 3.8f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.0002f));
-        shader.setMat4("model", model);
-        bedsideModel.Draw(shader);
-    }
-
-    void loadLocker(Model &lockerModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(3.2f, 6.0f, -4.0f));
-        model = glm::scale(model, glm::vec3(0.0002f));
-        shader.setMat4("model", model);
-        lockerModel.Draw(shader);
-    }
-
-    void loadBed(Model &bedModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(2.0f, 6.001f, 2.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.02f));
-        shader.setMat4("model", model);
-        bedModel.Draw(shader);
-    }
-
-
-    void loadTv(Model &tvModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(2.0f, 0.8435f, 3.5f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.0035f, 0.004f, 0.004f));
-        shader.setMat4("model", model);
-        tvModel.Draw(shader);
-    }
-
-    void loadDesk(Model &deskModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(2.0f, 0.005f, 3.5f));
-        model = glm::scale(model, glm::vec3(0.02f, 0.04f, 0.02f));
-        shader.setMat4("model", model);
-        deskModel.Draw(shader);
-    }
-
-    void loadFirstChair(Model &chairModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(-3.0f, -0.01f, 2.5f));
-        model = glm::rotate(model, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.02f));
-        shader.setMat4("model", model);
-        chairModel.Draw(shader);
     }
 
-    void loadSecondChair(Model &chairModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(-6.0f, -0.01f, 1.0f));
-        model = glm::rotate(model, glm::radians(100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.02f));
-        shader.setMat4("model", model);
-        chairModel.Draw(shader);
-    }
-
-    void loadThirdChair(Model &chairModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(-3.5f, -0.01f, -1.0f));
-        model = glm::rotate(model, glm::radians(60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.02f));
-        shader.setMat4("model", model);
-        chairModel.Draw(shader);
-    }
-
-    void loadTable(Model &tableModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(-4.0f, 0.85f, 0.8f));
-        model = glm::scale(model, glm::vec3(0.4f, 0.5f, 0.4f));
-        shader.setMat4("model", model);
-        tableModel.Draw(shader);
-    }
+    // Static scene: the building shell (floors, walls, pillars, tiles, roof) and the light markers never move.
+    // The routines below only describe them once at startup, the shell is baked into world space and drawn with one
+    // call per texture, the markers with one instanced call. The elevator door is submitted to the render queue by
+    // the routine above every frame, furniture and the elevator are placed by resources/scene.txt.
 
-    void loadStairs(Model &stairsModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(-6.9165f, 0.0009f, -1.65f));
-        model = glm::scale(model, glm::vec3(0.02f, 0.02264f, 0.0198f));
-        shader.setMat4("model", model);
-        stairsModel.Draw(shader);
-    }
-
-    void loadSofa(Model &sofaModel, glm::mat4 &model, Shader &shader) {
-        model = glm::translate(model, glm::vec3(2.0f, -0.01f, -3.3f));
-        model = glm::scale(model, glm::vec3(1.0f));
-        shader.setMat4("model", model);
-        sofaModel.Draw(shader);
-    }
-
-    void settingUpLight(Shader &lightShader, glm::mat4 &model) {
+    void settingUpLight(rg::InstanceBatch &lights) {
         glm::vec3 light_positions[] = {
                 glm::vec3(0.0f, 1.9f, 3.6f),
                 glm::vec3(0.4f, 1.9f, 4.0f),
@@ -187,21 +100,17 @@ public:
         int n = 12;
 
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, light_positions[i]);
             model = glm::scale(model, glm::vec3(0.1f));
-            lightShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            lights.add(model);
         }
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
             light_positions[i].x += 4.0f;
             model = glm::translate(model, light_positions[i]);
             model = glm::scale(model, glm::vec3(0.1f));
-            lightShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            lights.add(model);
         }
 
 //        model = glm::mat4(1.0f);
@@ -212,21 +121,20 @@ public:
 //        glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
-    void settingUpRoof(Shader &shader, glm::mat4 &model) {
+    void settingUpRoof(rg::StaticGeometry &shell, const rg::StaticGeometry::Shape &cube, unsigned int tile) {
         int n = 3;
         float x = 5.0f;
 
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, glm::vec3(x, 11.75f, 0.0f));
             model = glm::scale(model, glm::vec3(0.4f, 0.4f, 10.0f));
-            shader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            shell.add(cube, tile, model);
             x -= 5.0f;
         }
     }
 
-    void settingUpTilesInWall(Shader &shader, glm::mat4 &model) {
+    void settingUpTilesInWall(rg::StaticGeometry &shell, const rg::StaticGeometry::Shape &cube, unsigned int tile) {
         float tiles_in_wall_x_positions[] = {
                 6.5f, 4.75f, 3.0f, 1.25f, -0.5f, -2.25f, -4.0f, -5.75f, -7.5f
         };
@@ -234,26 +142,22 @@ public:
         int n = 9;
 
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, glm::vec3(tiles_in_wall_x_positions[i], y, z));
             model = glm::scale(model, glm::vec3(1.5f, 0.1f, 1.5f));
-            shader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            shell.add(cube, tile, model);
         }
 
         z *= -1;
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
+            glm::mat4 model = glm::mat4(1.0f);
             model = glm::translate(model, glm::vec3(tiles_in_wall_x_positions[i], y, z));
             model = glm::scale(model, glm::vec3(1.5f, 0.1f, 1.5f));
-            shader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            shell.add(cube, tile, model);
         }
     }
 
-    void settingUpTilesInPillar(Shader &shader, glm::mat4 &model) {
+    void settingUpTilesInPillar(rg::StaticGeometry &shell, const rg::StaticGeometry::Shape &cube, unsigned int wood) {
         float x = 0.0f, y, z = 4.0f;
         int m = 2, n = 4;
 
@@ -261,13 +165,11 @@ public:
 
             y = 0.0f;
             for (int i = 0; i < n; ++i) {
-                model = glm::mat4(1.0f);
+                glm::mat4 model = glm::mat4(1.0f);
                 model = glm::translate(model, glm::vec3(x, y, z));
                 // 1.1f -> x, z
                 model = glm::scale(model, glm::vec3(1.0f, 0.1f, 1.0f));
-                shader.setMat4("model", model);
-
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                shell.add(cube, wood, model);
                 y += 2.0f;
             }
             x = 4.0f;
@@ -275,19 +177,15 @@ public:
         }
     }
 
-    void settingUpFloor(Shader &shader, glm::mat4 &model, unsigned int floor) {
-        glBindTexture(GL_TEXTURE_2D, floor);
-
-        model = glm::mat4(1.0f);
+    void settingUpFloor(rg::StaticGeometry &shell, const rg::StaticGeometry::Shape &floorShape, unsigned int floor) {
+        glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        shell.add(floorShape, floor, model);
 
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(1.05f, 6.0f, 0.0f));
         model = glm::scale(model,glm::vec3(0.85f, 1.0f, 1.0f));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        shell.add(floorShape, floor, model);
 
 //        model = glm::mat4(1.0f);
 //        model = glm::translate(model, glm::vec3(0.0f, 12.0f, 0.0f));
@@ -295,65 +193,50 @@ public:
 //        glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
-    void settingUpPillar(Shader& shader, glm::mat4 &model, unsigned int stone) {
+    // every pillar is a stack of 0.7 x 1 x 0.7 boxes, merged into one column
+    void settingUpPillar(rg::StaticGeometry &shell, unsigned int stone) {
         int n = 6;
         float y = 0.5f;
 
-        glBindTexture(GL_TEXTURE_2D, stone);
+        rg::VoxelGrid firstPillar(glm::vec3(-0.35f, 0.0f, 3.65f), glm::vec3(0.7f, 1.0f, 0.7f));
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, y, 4.0f));
-            model = glm::scale(model, glm::vec3(0.7f, 1.0f, 0.7f));
-            shader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            firstPillar.set(glm::vec3(0.0f, y, 4.0f), stone);
             y += 1.0f;
         }
+        firstPillar.mesh(shell);
 
         y = 0.5f;
+        rg::VoxelGrid secondPillar(glm::vec3(3.65f, 0.0f, 3.65f), glm::vec3(0.7f, 1.0f, 0.7f));
         for (int i = 0; i < n; ++i) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(4.0f, y, 4.0f));
-            model = glm::scale(model, glm::vec3(0.7f, 1.0f, 0.7f));
-            shader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            secondPillar.set(glm::vec3(4.0f, y, 4.0f), stone);
             y += 1.0f;
         }
+        secondPillar.mesh(shell);
     }
 
-    void settingUpWall(Shader &shader, glm::mat4 &model, unsigned int tile, unsigned int wall, float height) {
+    // unit cubes on the integer grid, meshed by the caller once all rows are in
+    void settingUpWall(rg::VoxelGrid &walls, unsigned int tile, unsigned int wall, float height) {
         float x, y = height, z;
         int m = 6, n = 14, k = 11;
 
         for (int j = 0; j < m; ++j) {
-            glBindTexture(GL_TEXTURE_2D, wall);
-            if (j == 1 || j == 4) {
-                glBindTexture(GL_TEXTURE_2D, tile);
-            }
+            unsigned int texture = j == 1 || j == 4 ? tile : wall;
 
             x = 6.5f, z = -5.5f;
             for (int i = 0; i < n; ++i) {
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3(x, y, z));
-                shader.setMat4("model", model);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                walls.set(glm::vec3(x, y, z), texture);
 
                 x -= 1.0f;
             }
 
             for (int i = 0; i < k; ++i) {
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3(x, y, z));
-                shader.setMat4("model", model);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                walls.set(glm::vec3(x, y, z), texture);
 
                 z += 1.0f;
             }
 
             for (int i = 0; i <= n; ++i) {
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3(x, y, z));
-                shader.setMat4("model", model);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                walls.set(glm::vec3(x, y, z), texture);
 
                 x += 1.0f;
             }
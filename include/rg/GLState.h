@@ -0,0 +1,357 @@
+#ifndef PROJECT_BASE_GLSTATE_H
+#define PROJECT_BASE_GLSTATE_H
+
+#include <glad/glad.h>
+
+#include <rg/GLExtensions.h>
+
+namespace rg {
+
+// Shadow copy of the binds and fixed-function state the frame changes, every call that would set what is already
+// set is dropped. Nothing is dropped before the first beginFrame(): setup code binds objects directly while it
+// creates them, so the cache only starts filtering once beginFrame() has forgotten everything, and from then on
+// every bind of the frame has to go through it. Deleted objects must be passed to forget*, as GL reuses their names.
+// Counts issued and filtered calls per frame. GL thread only.
+class GLState {
+public:
+    enum Call {
+        Program,
+        VertexArray,
+        ActiveTexture,
+        Texture,
+        Buffer,
+        Capability,
+        Depth,
+        Blend,
+        Framebuffer,
+        CallCount
+    };
+
+    struct Stats {
+        unsigned int issued[CallCount] = {};
+        unsigned int filtered[CallCount] = {};
+
+        unsigned int totalIssued() const {
+            unsigned int total = 0;
+            for (unsigned int count : issued) {
+                total += count;
+            }
+            return total;
+        }
+
+        unsigned int totalFiltered() const {
+            unsigned int total = 0;
+            for (unsigned int count : filtered) {
+                total += count;
+            }
+            return total;
+        }
+    };
+
+    static const unsigned int MaxUnits = 16;
+
+    static GLState& instance() {
+        static GLState state;
+        return state;
+    }
+
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    static const char* callName(Call call) {
+        static const char *names[CallCount] = {
+                "program", "vertex array", "active texture", "texture", "buffer", "enable", "depth", "blend", "framebuffer"
+        };
+        return names[call];
+    }
+
+    // once per frame before anything is drawn, keeps the previous frame's counters for lastFrame()
+    void beginFrame() {
+        m_LastFrame = m_Stats;
+        m_Stats = Stats();
+        invalidate();
+        m_Filtering = true;
+    }
+
+    // forgets everything, for when GL state was changed behind the cache's back
+    void invalidate() {
+        m_Program = Unknown;
+        m_VertexArray = Unknown;
+        m_ActiveUnit = Unknown;
+        for (auto &unit : m_Textures) {
+            for (unsigned int &texture : unit) {
+                texture = Unknown;
+            }
+        }
+        for (unsigned int &buffer : m_Buffers) {
+            buffer = Unknown;
+        }
+        for (int &capability : m_Capabilities) {
+            capability = -1;
+        }
+        m_DepthMask = -1;
+        m_DepthFunc = Unknown;
+        m_BlendSource = m_BlendDestination = Unknown;
+        m_DrawFramebuffer = m_ReadFramebuffer = Unknown;
+    }
+
+    // each returns whether the call was issued
+    bool useProgram(unsigned int program) {
+        if (!set(Program, m_Program, program)) {
+            return false;
+        }
+        glUseProgram(program);
+        return true;
+    }
+
+    bool bindVertexArray(unsigned int vertexArray) {
+        if (!set(VertexArray, m_VertexArray, vertexArray)) {
+            return false;
+        }
+        glBindVertexArray(vertexArray);
+        return true;
+    }
+
+    bool activeTexture(unsigned int unit) {
+        if (!set(ActiveTexture, m_ActiveUnit, unit)) {
+            return false;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        return true;
+    }
+
+    // binds to `unit`, switching the active unit only if the texture isn't bound there yet
+    bool bindTexture(unsigned int unit, GLenum target, unsigned int texture) {
+        int slot = textureSlot(target);
+        if (slot < 0 || unit >= MaxUnits) {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+            ++m_Stats.issued[Texture];
+            return true;
+        }
+        if (m_Filtering && m_Textures[unit][slot] == texture) {
+            ++m_Stats.filtered[Texture];
+            return false;
+        }
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        m_Textures[unit][slot] = texture;
+        ++m_Stats.issued[Texture];
+        return true;
+    }
+
+    // the element array binding belongs to the VAO and is never cached
+    bool bindBuffer(GLenum target, unsigned int buffer) {
+        int slot = bufferSlot(target);
+        if (slot < 0) {
+            glBindBuffer(target, buffer);
+            ++m_Stats.issued[Buffer];
+            return true;
+        }
+        if (!set(Buffer, m_Buffers[slot], buffer)) {
+            return false;
+        }
+        glBindBuffer(target, buffer);
+        return true;
+    }
+
+    // indexed binds are always issued (the ranges change every frame), they also set the generic binding
+    void bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size) {
+        glBindBufferRange(target, index, buffer, offset, size);
+        ++m_Stats.issued[Buffer];
+        int slot = bufferSlot(target);
+        if (slot >= 0) {
+            m_Buffers[slot] = buffer;
+        }
+    }
+
+    bool enable(GLenum capability) {
+        return setCapability(capability, true);
+    }
+
+    bool disable(GLenum capability) {
+        return setCapability(capability, false);
+    }
+
+    bool depthMask(bool write) {
+        int value = write ? 1 : 0;
+        if (m_Filtering && m_DepthMask == value) {
+            ++m_Stats.filtered[Depth];
+            return false;
+        }
+        m_DepthMask = value;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        ++m_Stats.issued[Depth];
+        return true;
+    }
+
+    bool depthFunc(GLenum function) {
+        if (!set(Depth, m_DepthFunc, function)) {
+            return false;
+        }
+        glDepthFunc(function);
+        return true;
+    }
+
+    bool blendFunc(GLenum source, GLenum destination) {
+        if (m_Filtering && m_BlendSource == source && m_BlendDestination == destination) {
+            ++m_Stats.filtered[Blend];
+            return false;
+        }
+        m_BlendSource = source;
+        m_BlendDestination = destination;
+        glBlendFunc(source, destination);
+        ++m_Stats.issued[Blend];
+        return true;
+    }
+
+    // GL_FRAMEBUFFER sets both the draw and the read binding
+    bool bindFramebuffer(GLenum target, unsigned int framebuffer) {
+        bool draw = target != GL_READ_FRAMEBUFFER && m_DrawFramebuffer != framebuffer;
+        bool read = target != GL_DRAW_FRAMEBUFFER && m_ReadFramebuffer != framebuffer;
+        if (m_Filtering && !draw && !read) {
+            ++m_Stats.filtered[Framebuffer];
+            return false;
+        }
+        if (target != GL_READ_FRAMEBUFFER) {
+            m_DrawFramebuffer = framebuffer;
+        }
+        if (target != GL_DRAW_FRAMEBUFFER) {
+            m_ReadFramebuffer = framebuffer;
+        }
+        glBindFramebuffer(target, framebuffer);
+        ++m_Stats.issued[Framebuffer];
+        return true;
+    }
+
+    // call after deleting objects, a later object with the same name would otherwise look bound already
+    void forgetProgram(unsigned int program) {
+        if (m_Program == program) {
+            m_Program = Unknown;
+        }
+    }
+
+    void forgetTexture(unsigned int texture) {
+        for (auto &unit : m_Textures) {
+            for (unsigned int &bound : unit) {
+                if (bound == texture) {
+                    bound = Unknown;
+                }
+            }
+        }
+    }
+
+    void forgetBuffer(unsigned int buffer) {
+        for (unsigned int &bound : m_Buffers) {
+            if (bound == buffer) {
+                bound = Unknown;
+            }
+        }
+    }
+
+    void forgetVertexArray(unsigned int vertexArray) {
+        if (m_VertexArray == vertexArray) {
+            m_VertexArray = Unknown;
+        }
+    }
+
+    // counters of the frame in progress
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    // counters of the last complete frame
+    const Stats& lastFrame() const {
+        return m_LastFrame;
+    }
+
+private:
+    static const unsigned int Unknown = ~0u;
+    static const unsigned int TextureTargets = 3;
+    static const unsigned int BufferTargets = 7;
+    static const unsigned int Capabilities = 4;
+
+    unsigned int m_Program = Unknown;
+    unsigned int m_VertexArray = Unknown;
+    unsigned int m_ActiveUnit = Unknown;
+    unsigned int m_Textures[MaxUnits][TextureTargets];
+    unsigned int m_Buffers[BufferTargets];
+    int m_Capabilities[Capabilities]; // -1 unknown, else enabled
+    int m_DepthMask = -1;
+    unsigned int m_DepthFunc = Unknown;
+    unsigned int m_BlendSource = Unknown;
+    unsigned int m_BlendDestination = Unknown;
+    unsigned int m_DrawFramebuffer = Unknown;
+    unsigned int m_ReadFramebuffer = Unknown;
+    bool m_Filtering = false;
+    Stats m_Stats;
+    Stats m_LastFrame;
+
+    GLState() {
+        invalidate();
+    }
+
+    bool set(Call call, unsigned int &cached, unsigned int value) {
+        if (m_Filtering && cached == value) {
+            ++m_Stats.filtered[call];
+            return false;
+        }
+        cached = value;
+        ++m_Stats.issued[call];
+        return true;
+    }
+
+    bool setCapability(GLenum capability, bool enabled) {
+        int slot = capabilitySlot(capability);
+        if (m_Filtering && slot >= 0 && m_Capabilities[slot] == (enabled ? 1 : 0)) {
+            ++m_Stats.filtered[Capability];
+            return false;
+        }
+        if (slot >= 0) {
+            m_Capabilities[slot] = enabled ? 1 : 0;
+        }
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+        ++m_Stats.issued[Capability];
+        return true;
+    }
+
+    static int textureSlot(GLenum target) {
+        switch (target) {
+            case GL_TEXTURE_2D: return 0;
+            case GL_TEXTURE_CUBE_MAP: return 1;
+            case GL_TEXTURE_2D_ARRAY: return 2;
+            default: return -1;
+        }
+    }
+
+    static int bufferSlot(GLenum target) {
+        switch (target) {
+            case GL_ARRAY_BUFFER: return 0;
+            case GL_COPY_READ_BUFFER: return 1;
+            case GL_COPY_WRITE_BUFFER: return 2;
+            case GL_PIXEL_UNPACK_BUFFER: return 3;
+            case GL_UNIFORM_BUFFER: return 4;
+            case GL_DRAW_INDIRECT_BUFFER: return 5;
+            case GL_SHADER_STORAGE_BUFFER: return 6;
+            default: return -1;
+        }
+    }
+
+    static int capabilitySlot(GLenum capability) {
+        switch (capability) {
+            case GL_DEPTH_TEST: return 0;
+            case GL_BLEND: return 1;
+            case GL_CULL_FACE: return 2;
+            case GL_STENCIL_TEST: return 3;
+            default: return -1;
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_GLSTATE_H
@@ -0,0 +1,197 @@
+#ifndef PROJECT_BASE_GEOMETRYARENA_H
+#define PROJECT_BASE_GEOMETRYARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <map>
+
+namespace rg {
+
+// How the vertices of one layout are stored and read. setupAttributes is called with the pool's VAO and vertex
+// buffer bound and points the attributes at offsets from the start of the buffer.
+struct VertexLayout {
+    size_t stride;
+    void (*setupAttributes)();
+};
+
+// Scene-wide vertex and index storage. Every vertex layout gets one VAO with one vertex and one index buffer,
+// meshes are appended to them and drawn with glDrawElementsBaseVertex, so the whole scene lives in a handful of
+// buffers and a model's submeshes are contiguous ranges drawn under a single VAO bind. Index ranges may be 16 or
+// 32 bit; they are relative to the mesh's first vertex, so small meshes get 16-bit indices wherever they land.
+// GL thread only.
+class GeometryArena {
+public:
+    // where a mesh ended up, baseVertex is added to every index it draws
+    struct Range {
+        unsigned int vao = 0;
+        int baseVertex = 0;
+        size_t indexOffset = 0; // in bytes
+        size_t indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+    };
+
+    static size_t indexSize(GLenum indexType) {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
+
+    static GeometryArena& instance() {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // appends the mesh to the buffers of `layout` (which must outlive the arena), growing them if needed
+    Range allocate(const VertexLayout &layout, const void *vertices, size_t vertexCount,
+                   const void *indices, size_t indexCount, GLenum indexType = GL_UNSIGNED_INT) {
+        Pool &pool = m_Pools[&layout];
+        if (!pool.vao) {
+            create(pool, layout);
+        }
+        // keep every range aligned to its index size
+        size_t indexOffset = (pool.indexBytes + 3) & ~(size_t)3;
+        size_t indexBytes = indexCount * indexSize(indexType);
+        reserve(pool, layout, pool.vertexCount + vertexCount, indexOffset + indexBytes);
+
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, pool.vertexCount * layout.stride, vertexCount * layout.stride, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        Range range;
+        range.vao = pool.vao;
+        range.baseVertex = (int)pool.vertexCount;
+        pool.vertexCount += vertexCount;
+        writeIndices(pool, range, indexOffset, indices, indexCount, indexType);
+        return range;
+    }
+
+    // appends another index buffer over the vertices of `base` (e.g. a coarser level of detail)
+    Range allocateIndices(const VertexLayout &layout, const Range &base, const void *indices, size_t indexCount,
+                          GLenum indexType = GL_UNSIGNED_INT) {
+        Pool &pool = m_Pools[&layout];
+        size_t indexOffset = (pool.indexBytes + 3) & ~(size_t)3;
+        reserve(pool, layout, pool.vertexCount, indexOffset + indexCount * indexSize(indexType));
+
+        Range range;
+        range.vao = pool.vao;
+        range.baseVertex = base.baseVertex;
+        writeIndices(pool, range, indexOffset, indices, indexCount, indexType);
+        return range;
+    }
+
+    static void draw(const Range &range) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)range.indexCount, range.indexType,
+                                 (void*)range.indexOffset, range.baseVertex);
+    }
+
+    void printStats() const {
+        size_t used = 0, reserved = 0;
+        for (const auto &entry : m_Pools) {
+            used += entry.second.vertexCount * entry.first->stride + entry.second.indexBytes;
+            reserved += entry.second.vertexCapacity * entry.first->stride + entry.second.indexCapacity;
+        }
+        std::cout << "GEOMETRY_ARENA:: " << m_Pools.size() * 2 << " buffers, " << used / (1024.0 * 1024.0) << " MB used of "
+                  << reserved / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+    // must be called while the GL context is still alive
+    void shutdown() {
+        for (auto &entry : m_Pools) {
+            Pool &pool = entry.second;
+            glDeleteVertexArrays(1, &pool.vao);
+            glDeleteBuffers(1, &pool.vbo);
+            glDeleteBuffers(1, &pool.ebo);
+        }
+        m_Pools.clear();
+    }
+
+private:
+    struct Pool {
+        unsigned int vao = 0;
+        unsigned int vbo = 0;
+        unsigned int ebo = 0;
+        size_t vertexCount = 0;
+        size_t vertexCapacity = 0;
+        size_t indexBytes = 0;
+        size_t indexCapacity = 0; // in bytes
+    };
+
+    std::map<const VertexLayout*, Pool> m_Pools;
+
+    GeometryArena() = default;
+
+    static void writeIndices(Pool &pool, Range &range, size_t indexOffset, const void *indices, size_t indexCount, GLenum indexType) {
+        size_t indexBytes = indexCount * indexSize(indexType);
+        // not through GL_ELEMENT_ARRAY_BUFFER, that would change whatever VAO is bound
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        range.indexOffset = indexOffset;
+        range.indexCount = indexCount;
+        range.indexType = indexType;
+        pool.indexBytes = indexOffset + indexBytes;
+    }
+
+    static void create(Pool &pool, const VertexLayout &layout) {
+        glGenVertexArrays(1, &pool.vao);
+        glGenBuffers(1, &pool.vbo);
+        glGenBuffers(1, &pool.ebo);
+        // small to begin with, reserve() doubles the pool as meshes are added: 64K vertices, 1 MB of indices
+        pool.vertexCapacity = 1u << 16;
+        pool.indexCapacity = 1u << 20;
+
+        glBindVertexArray(pool.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        glBufferData(GL_ARRAY_BUFFER, pool.vertexCapacity * layout.stride, nullptr, GL_STATIC_DRAW);
+        layout.setupAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, pool.indexCapacity, nullptr, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // moves the pool into larger buffers, keeping what it already holds
+    static void reserve(Pool &pool, const VertexLayout &layout, size_t vertexCount, size_t indexBytes) {
+        if (vertexCount <= pool.vertexCapacity && indexBytes <= pool.indexCapacity) {
+            return;
+        }
+        if (vertexCount > pool.vertexCapacity) {
+            pool.vertexCapacity = std::max(vertexCount, pool.vertexCapacity * 2);
+            pool.vbo = grow(pool.vbo, pool.vertexCount * layout.stride, pool.vertexCapacity * layout.stride);
+        }
+        if (indexBytes > pool.indexCapacity) {
+            pool.indexCapacity = std::max(indexBytes, pool.indexCapacity * 2);
+            pool.ebo = grow(pool.ebo, pool.indexBytes, pool.indexCapacity);
+        }
+
+        // the VAO still references the old buffers
+        glBindVertexArray(pool.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        layout.setupAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    static unsigned int grow(unsigned int buffer, size_t used, size_t capacity) {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return grown;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_GEOMETRYARENA_H
@@ -0,0 +1,104 @@
+#ifndef PROJECT_BASE_INSTANCEBATCH_H
+#define PROJECT_BASE_INSTANCEBATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/GeometryArena.h>
+#include <rg/RenderQueue.h>
+
+#include <vector>
+
+namespace rg {
+
+// Many copies of one small non-indexed mesh drawn with a single glDrawArraysInstanced. The model matrices are
+// collected with add(), then upload() moves them into an instance buffer read at attribute locations
+// ModelAttribute..ModelAttribute+3 (one column each, advancing per instance) and frees them, shaders declare it as
+// layout (location = 5) in mat4 aInstanceModel. GL thread only.
+class InstanceBatch {
+public:
+    // after the ones Mesh uses
+    static const unsigned int ModelAttribute = 5;
+
+    InstanceBatch() = default;
+    InstanceBatch(const InstanceBatch&) = delete;
+    InstanceBatch& operator=(const InstanceBatch&) = delete;
+
+    void add(const glm::mat4 &model) {
+        m_Models.push_back(model);
+    }
+
+    // builds a VAO reading `vertexCount` vertices from `vertexBuffer` as described by `layout`, plus the instances
+    void upload(unsigned int vertexBuffer, const VertexLayout &layout, unsigned int vertexCount) {
+        m_VertexCount = vertexCount;
+        m_InstanceCount = (unsigned int)m_Models.size();
+        // the middle of the instances' translations, what the queue sorts the batch by
+        if (!m_Models.empty()) {
+            glm::vec3 minimum = glm::vec3(m_Models.front()[3]), maximum = minimum;
+            for (const glm::mat4 &model : m_Models) {
+                minimum = glm::min(minimum, glm::vec3(model[3]));
+                maximum = glm::max(maximum, glm::vec3(model[3]));
+            }
+            m_Center = (minimum + maximum) * 0.5f;
+        }
+
+        glGenVertexArrays(1, &m_Vao);
+        glGenBuffers(1, &m_InstanceBuffer);
+        glBindVertexArray(m_Vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        layout.setupAttributes();
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, m_Models.size() * sizeof(glm::mat4), m_Models.data(), GL_STATIC_DRAW);
+        for (unsigned int column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(ModelAttribute + column);
+            glVertexAttribPointer(ModelAttribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(ModelAttribute + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        std::vector<glm::mat4>().swap(m_Models);
+    }
+
+    // one queue item drawing every instance with `shader`, ordered by the middle of the instances
+    void submit(RenderQueue &queue, const Shader &shader) const {
+        RenderQueue::Item item;
+        item.shader = &shader;
+        item.vao = m_Vao;
+        item.setModel = false;
+        item.draw = drawQueued;
+        item.object = this;
+        queue.submit(RenderQueue::Opaque, item, m_Center);
+    }
+
+    unsigned int instanceCount() const {
+        return m_InstanceCount;
+    }
+
+    // must be called while the GL context is still alive
+    void destroy() {
+        glDeleteVertexArrays(1, &m_Vao);
+        glDeleteBuffers(1, &m_InstanceBuffer);
+        m_Vao = 0;
+        m_InstanceBuffer = 0;
+    }
+
+private:
+    std::vector<glm::mat4> m_Models;
+    unsigned int m_Vao = 0;
+    unsigned int m_InstanceBuffer = 0;
+    unsigned int m_VertexCount = 0;
+    unsigned int m_InstanceCount = 0;
+    glm::vec3 m_Center = glm::vec3(0.0f);
+
+    static void drawQueued(const RenderQueue::Item &item) {
+        const InstanceBatch &batch = *(const InstanceBatch*)item.object;
+        glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei)batch.m_VertexCount, (GLsizei)batch.m_InstanceCount);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_INSTANCEBATCH_H
@@ -0,0 +1,79 @@
+#ifndef PROJECT_BASE_LODSELECTOR_H
+#define PROJECT_BASE_LODSELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+namespace rg {
+
+// Picks a level of detail from the size of an object's bounding sphere on screen. Level k (k >= 1) becomes
+// eligible once the sphere's projected diameter drops below FullDetailSize / 2^(k-1) pixels. Switching only
+// happens a hysteresis margin past a threshold, so objects hovering around one don't pop back and forth.
+// beginFrame() must be called once per frame before anything is drawn.
+class LodSelector {
+public:
+    static constexpr float FullDetailSize = 512.0f; // pixels
+    static constexpr float Hysteresis = 0.15f;
+
+    // log2 scale on the projected size, positive values switch to coarser levels sooner
+    float bias = 0.0f;
+
+    static LodSelector& instance() {
+        static LodSelector selector;
+        return selector;
+    }
+
+    void beginFrame(const glm::vec3 &cameraPosition, float fovY, float viewportHeight) {
+        m_CameraPosition = cameraPosition;
+        m_PixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY / 2.0f));
+        ++m_Frame;
+    }
+
+    unsigned int frame() const {
+        return m_Frame;
+    }
+
+    // projected diameter in pixels of a world space sphere
+    float projectedSize(const glm::vec3 &center, float radius) const {
+        float distance = glm::length(center - m_CameraPosition);
+        if (distance <= radius) {
+            return m_PixelsPerUnit * 1e6f; // camera inside the sphere
+        }
+        return 2.0f * radius * m_PixelsPerUnit / distance;
+    }
+
+    // the level (< levelCount) to draw a sphere with, given the level it was drawn with last frame
+    unsigned int select(const glm::vec3 &center, float radius, unsigned int current, unsigned int levelCount) const {
+        if (levelCount <= 1) {
+            return 0;
+        }
+        float size = projectedSize(center, radius) / std::exp2(bias);
+        if (current >= levelCount) {
+            current = levelCount - 1;
+        }
+        while (current + 1 < levelCount && size < threshold(current + 1) * (1.0f - Hysteresis)) {
+            ++current;
+        }
+        while (current > 0 && size > threshold(current) * (1.0f + Hysteresis)) {
+            --current;
+        }
+        return current;
+    }
+
+private:
+    glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+    float m_PixelsPerUnit = 1.0f;
+    unsigned int m_Frame = 0;
+
+    LodSelector() = default;
+
+    // projected size below which `level` may be used
+    static float threshold(unsigned int level) {
+        return FullDetailSize / (float)(1u << (level - 1));
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_LODSELECTOR_H
@@ -0,0 +1,326 @@
+#ifndef PROJECT_BASE_MESHCACHE_H
+#define PROJECT_BASE_MESHCACHE_H
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/mesh.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Binary cache of fully processed model meshes (post Assimp triangulation, normals and tangents).
+// One file per source model, keyed by source path, its mtime and the aiProcess flags used to import it.
+// Every mesh is followed by the index buffers of its coarser levels of detail.
+// Entries are mmap-ed on load so Model can go straight to setupMesh without touching Assimp.
+class MeshCache {
+public:
+    // bump whenever the on-disk layout or the processing that produces it changes
+    static const uint32_t Version = 3;
+
+    // updated from the model loader's worker threads
+    struct Stats {
+        std::atomic<unsigned int> hits{0};
+        std::atomic<unsigned int> misses{0};
+        std::atomic<unsigned int> invalidations{0};
+        std::atomic<unsigned int> writes{0};
+    };
+
+    struct IndexView {
+        const unsigned int *indices;
+        uint32_t indexCount;
+    };
+
+    struct MeshView {
+        const Vertex *vertices;
+        uint32_t vertexCount;
+        const unsigned int *indices;
+        uint32_t indexCount;
+        std::vector<Texture> textures; // type and path only
+        std::vector<IndexView> lods;
+    };
+
+    MeshCache() = default;
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    ~MeshCache() {
+        close();
+    }
+
+    // maps the cache entry for the model at `path`, returns false on a miss or a stale entry
+    bool open(const std::string &path, unsigned int flags) {
+        close();
+
+        int64_t mtime;
+        if (!sourceMtime(path, mtime)) {
+            return false;
+        }
+
+        std::string file = entryPath(path);
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            ++stats().misses;
+            std::cout << "MESH_CACHE::MISS " << path << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            m_Size = (size_t)st.st_size;
+            void *data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+            m_Data = data == MAP_FAILED ? nullptr : (const unsigned char*)data;
+        }
+        ::close(fd);
+
+        if (!m_Data || !parse(path, flags, mtime)) {
+            close();
+            ++stats().invalidations;
+            std::cout << "MESH_CACHE::INVALIDATED " << path << std::endl;
+            return false;
+        }
+
+        ++stats().hits;
+        return true;
+    }
+
+    const std::vector<MeshView>& meshes() const {
+        return m_Meshes;
+    }
+
+    void close() {
+        if (m_Data) {
+            munmap((void*)m_Data, m_Size);
+        }
+        m_Data = nullptr;
+        m_Size = 0;
+        m_Meshes.clear();
+    }
+
+    // writes the processed meshes of the model at `path` to its cache entry
+    static void store(const std::string &path, unsigned int flags, const std::vector<MeshData> &meshes) {
+        int64_t mtime;
+        if (!sourceMtime(path, mtime)) {
+            return;
+        }
+
+        std::string dir = FileSystem::getPath("resources/cache");
+        mkdir(dir.c_str(), 0755);
+        std::string file = entryPath(path);
+        std::string tmp = file + ".tmp";
+
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "MESH_CACHE::WRITE_FAILED " << file << std::endl;
+            return;
+        }
+
+        FileHeader header;
+        std::memcpy(header.magic, "RGMC", 4);
+        header.version = Version;
+        header.flags = flags;
+        header.meshCount = (uint32_t)meshes.size();
+        header.mtime = mtime;
+        header.vertexSize = sizeof(Vertex);
+        header.pathLength = (uint32_t)path.size();
+        out.write((const char*)&header, sizeof(header));
+        writePadded(out, path);
+
+        for (const MeshData &mesh : meshes) {
+            MeshHeader meshHeader;
+            meshHeader.vertexCount = (uint32_t)mesh.vertices.size();
+            meshHeader.indexCount = (uint32_t)mesh.indices.size();
+            meshHeader.textureCount = (uint32_t)mesh.textures.size();
+            meshHeader.lodCount = (uint32_t)mesh.lods.size();
+            out.write((const char*)&meshHeader, sizeof(meshHeader));
+
+            for (const Texture &texture : mesh.textures) {
+                uint32_t lengths[2] = { (uint32_t)texture.type.size(), (uint32_t)texture.path.size() };
+                out.write((const char*)lengths, sizeof(lengths));
+                writePadded(out, texture.type);
+                writePadded(out, texture.path);
+            }
+
+            out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            for (const std::vector<unsigned int> &lod : mesh.lods) {
+                uint32_t indexCount = (uint32_t)lod.size();
+                out.write((const char*)&indexCount, sizeof(indexCount));
+                out.write((const char*)lod.data(), lod.size() * sizeof(unsigned int));
+            }
+        }
+
+        out.close();
+        if (!out || std::rename(tmp.c_str(), file.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            std::cout << "MESH_CACHE::WRITE_FAILED " << file << std::endl;
+            return;
+        }
+        ++stats().writes;
+    }
+
+    static Stats& stats() {
+        static Stats s;
+        return s;
+    }
+
+    static void printStats() {
+        const Stats &s = stats();
+        unsigned int hits = s.hits, misses = s.misses, invalidations = s.invalidations;
+        unsigned int lookups = hits + misses + invalidations;
+        std::cout << "MESH_CACHE:: " << hits << '/' << lookups << " hits ("
+                  << (lookups ? 100.0f * hits / lookups : 0.0f) << "%), "
+                  << misses << " misses, " << invalidations << " invalidations, "
+                  << s.writes << " entries written" << std::endl;
+    }
+
+private:
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t meshCount;
+        int64_t mtime;
+        uint32_t vertexSize;
+        uint32_t pathLength;
+    };
+
+    struct MeshHeader {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t lodCount;
+    };
+
+    const unsigned char *m_Data = nullptr;
+    size_t m_Size = 0;
+    std::vector<MeshView> m_Meshes;
+
+    static size_t padded(size_t n) {
+        return (n + 3) & ~(size_t)3;
+    }
+
+    static void writePadded(std::ofstream &out, const std::string &s) {
+        static const char zeros[4] = {};
+        out.write(s.data(), s.size());
+        out.write(zeros, padded(s.size()) - s.size());
+    }
+
+    static bool sourceMtime(const std::string &path, int64_t &mtime) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        mtime = (int64_t)st.st_mtime;
+        return true;
+    }
+
+    // FNV-1a of the source path, so every model gets its own entry
+    static std::string entryPath(const std::string &path) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.rgmesh", (unsigned long long)hash);
+        return FileSystem::getPath("resources/cache/") + name;
+    }
+
+    // validates the mapped entry against the source and builds views into it
+    bool parse(const std::string &path, unsigned int flags, int64_t mtime) {
+        size_t offset = 0;
+        auto take = [&](size_t n) -> const unsigned char* {
+            if (n > m_Size - offset) {
+                return nullptr;
+            }
+            const unsigned char *p = m_Data + offset;
+            offset += n;
+            return p;
+        };
+
+        const unsigned char *p = take(sizeof(FileHeader));
+        if (!p) {
+            return false;
+        }
+        FileHeader header;
+        std::memcpy(&header, p, sizeof(header));
+        if (std::memcmp(header.magic, "RGMC", 4) != 0 || header.version != Version || header.flags != flags
+            || header.mtime != mtime || header.vertexSize != sizeof(Vertex) || header.pathLength != path.size()) {
+            return false;
+        }
+        p = take(padded(header.pathLength));
+        if (!p || std::memcmp(p, path.data(), path.size()) != 0) {
+            return false;
+        }
+
+        m_Meshes.reserve(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; ++i) {
+            p = take(sizeof(MeshHeader));
+            if (!p) {
+                return false;
+            }
+            MeshHeader meshHeader;
+            std::memcpy(&meshHeader, p, sizeof(meshHeader));
+
+            MeshView view;
+            for (uint32_t t = 0; t < meshHeader.textureCount; ++t) {
+                const unsigned char *lengths = take(2 * sizeof(uint32_t));
+                if (!lengths) {
+                    return false;
+                }
+                uint32_t typeLength, pathLength;
+                std::memcpy(&typeLength, lengths, sizeof(uint32_t));
+                std::memcpy(&pathLength, lengths + sizeof(uint32_t), sizeof(uint32_t));
+                const unsigned char *type = take(padded(typeLength));
+                const unsigned char *texturePath = type ? take(padded(pathLength)) : nullptr;
+                if (!texturePath) {
+                    return false;
+                }
+                Texture texture;
+                texture.id = 0;
+                texture.type = std::string((const char*)type, typeLength);
+                texture.path = std::string((const char*)texturePath, pathLength);
+                view.textures.push_back(texture);
+            }
+
+            view.vertexCount = meshHeader.vertexCount;
+            view.vertices = (const Vertex*)take((size_t)meshHeader.vertexCount * sizeof(Vertex));
+            view.indexCount = meshHeader.indexCount;
+            view.indices = (const unsigned int*)take((size_t)meshHeader.indexCount * sizeof(unsigned int));
+            if (!view.vertices || !view.indices) {
+                return false;
+            }
+            for (uint32_t l = 0; l < meshHeader.lodCount; ++l) {
+                const unsigned char *count = take(sizeof(uint32_t));
+                if (!count) {
+                    return false;
+                }
+                IndexView lod;
+                std::memcpy(&lod.indexCount, count, sizeof(uint32_t));
+                lod.indices = (const unsigned int*)take((size_t)lod.indexCount * sizeof(unsigned int));
+                if (!lod.indices) {
+                    return false;
+                }
+                view.lods.push_back(lod);
+            }
+            m_Meshes.push_back(std::move(view));
+        }
+
+        return offset == m_Size;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_MESHCACHE_H
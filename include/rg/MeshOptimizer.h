@@ -0,0 +1,313 @@
+#ifndef PROJECT_BASE_MESHOPTIMIZER_H
+#define PROJECT_BASE_MESHOPTIMIZER_H
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Import-time optimization of processed meshes, run once before the result goes into the MeshCache:
+//  1. weld bitwise identical vertices (Assimp hands us three unshared vertices per triangle),
+//  2. reorder triangles for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation"),
+//  3. reorder cache-friendly clusters of triangles front to back from the outside in, to cut overdraw,
+//  4. renumber vertices in order of first use for vertex fetch locality.
+// Safe to call from worker threads.
+class MeshOptimizer {
+public:
+    // size of the FIFO cache ACMR is measured against
+    static const unsigned int MeasureCacheSize = 16;
+
+    // optimizes `mesh` in place and prints before/after vertex counts and ACMR, `name` identifies the mesh in the log
+    static void optimize(MeshData &mesh, const std::string &name) {
+        if (mesh.indices.size() < 3) {
+            return;
+        }
+        size_t verticesBefore = mesh.vertices.size();
+        float acmrBefore = acmr(mesh.indices, verticesBefore);
+
+        weld(mesh);
+        mesh.indices = optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        mesh.indices = optimizeOverdraw(mesh.indices, mesh.vertices);
+        optimizeVertexFetch(mesh);
+
+        std::ostringstream log;
+        log << "MESH_OPTIMIZER:: " << name << " vertices " << verticesBefore << " -> " << mesh.vertices.size()
+            << ", ACMR " << acmrBefore << " -> " << acmr(mesh.indices, mesh.vertices.size()) << "\n";
+        std::cout << log.str() << std::flush;
+    }
+
+    // average cache miss ratio: transformed vertices per triangle with a FIFO cache of MeasureCacheSize entries
+    static float acmr(const std::vector<unsigned int> &indices, size_t vertexCount) {
+        std::vector<unsigned int> insertedAt(vertexCount, 0);
+        unsigned int time = MeasureCacheSize + 1, misses = 0;
+        for (unsigned int index : indices) {
+            // a vertex is in the FIFO if fewer than MeasureCacheSize misses happened since it was inserted
+            if (time - insertedAt[index] > MeasureCacheSize) {
+                insertedAt[index] = time++;
+                ++misses;
+            }
+        }
+        return indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+    }
+
+    // merges vertices whose every attribute is bitwise equal
+    static void weld(MeshData &mesh) {
+        struct VertexHash {
+            size_t operator()(const Vertex *vertex) const {
+                const unsigned char *bytes = (const unsigned char*)vertex;
+                uint64_t hash = 14695981039346656037ull;
+                for (size_t i = 0; i < sizeof(Vertex); ++i) {
+                    hash = (hash ^ bytes[i]) * 1099511628211ull;
+                }
+                return (size_t)hash;
+            }
+        };
+        struct VertexEqual {
+            bool operator()(const Vertex *a, const Vertex *b) const {
+                return std::memcmp(a, b, sizeof(Vertex)) == 0;
+            }
+        };
+
+        std::unordered_map<const Vertex*, unsigned int, VertexHash, VertexEqual> unique;
+        unique.reserve(mesh.vertices.size());
+        std::vector<unsigned int> remap(mesh.vertices.size());
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < mesh.vertices.size(); ++i) {
+            auto inserted = unique.insert({ &mesh.vertices[i], count });
+            remap[i] = inserted.first->second;
+            if (inserted.second) {
+                ++count;
+            }
+        }
+        if (count == mesh.vertices.size()) {
+            return;
+        }
+
+        // remap[i] <= i, so compacting front to back never overwrites a vertex that is still needed
+        for (unsigned int i = 0; i < mesh.vertices.size(); ++i) {
+            mesh.vertices[remap[i]] = mesh.vertices[i];
+        }
+        mesh.vertices.resize(count);
+        for (unsigned int &index : mesh.indices) {
+            index = remap[index];
+        }
+    }
+
+    static std::vector<unsigned int> optimizeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount) {
+        const int CacheSize = 32;
+        size_t triangleCount = indices.size() / 3;
+
+        // triangles using each vertex, live ones first
+        std::vector<unsigned int> valence(vertexCount, 0);
+        for (unsigned int index : indices) {
+            ++valence[index];
+        }
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + valence[v];
+        }
+        std::vector<unsigned int> adjacency(indices.size());
+        {
+            std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t t = 0; t < triangleCount; ++t) {
+                for (int k = 0; k < 3; ++k) {
+                    adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+                }
+            }
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            vertexScores[v] = vertexScore(-1, valence[v], CacheSize);
+        }
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        int best = -1;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if (triangleScores[t] > bestScore) {
+                bestScore = triangleScores[t];
+                best = (int)t;
+            }
+        }
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        std::vector<unsigned int> cache, nextCache;
+        size_t cursor = 0;
+        while (result.size() < indices.size()) {
+            if (best < 0) {
+                // nothing connected to the cache is left, continue with the next unemitted triangle
+                while (emitted[cursor]) {
+                    ++cursor;
+                }
+                best = (int)cursor;
+            }
+
+            const unsigned int *triangle = &indices[best * 3];
+            emitted[best] = true;
+            nextCache.assign(triangle, triangle + 3);
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = triangle[k];
+                result.push_back(v);
+                // drop the triangle from the live part of the vertex's adjacency
+                unsigned int *first = &adjacency[adjacencyStart[v]];
+                unsigned int *last = first + valence[v];
+                *std::find(first, last, (unsigned int)best) = *(last - 1);
+                --valence[v];
+            }
+            for (unsigned int v : cache) {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                    nextCache.push_back(v);
+                }
+            }
+
+            // rescore everything that moved in or out of the cache, then the triangles around it
+            for (size_t i = 0; i < nextCache.size(); ++i) {
+                unsigned int v = nextCache[i];
+                cachePosition[v] = i < (size_t)CacheSize ? (int)i : -1;
+                vertexScores[v] = vertexScore(cachePosition[v], valence[v], CacheSize);
+            }
+            best = -1;
+            bestScore = -1.0f;
+            for (unsigned int v : nextCache) {
+                for (unsigned int a = adjacencyStart[v]; a < adjacencyStart[v] + valence[v]; ++a) {
+                    unsigned int t = adjacency[a];
+                    triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        best = (int)t;
+                    }
+                }
+            }
+
+            if (nextCache.size() > (size_t)CacheSize) {
+                nextCache.resize(CacheSize);
+            }
+            cache.swap(nextCache);
+        }
+        return result;
+    }
+
+    // Splits the cache-optimized order into clusters wherever the FIFO cache would restart anyway (a triangle that
+    // misses on all three vertices) and sorts the clusters so the ones facing away from the mesh centre go first:
+    // those are the outer surfaces most likely to occlude the rest. ACMR only changes at cluster borders.
+    static std::vector<unsigned int> optimizeOverdraw(const std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices) {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<size_t> clusterStarts;
+        {
+            std::vector<unsigned int> insertedAt(vertices.size(), 0);
+            unsigned int time = MeasureCacheSize + 1;
+            for (size_t t = 0; t < triangleCount; ++t) {
+                int misses = 0;
+                for (int k = 0; k < 3; ++k) {
+                    unsigned int index = indices[t * 3 + k];
+                    if (time - insertedAt[index] > MeasureCacheSize) {
+                        insertedAt[index] = time++;
+                        ++misses;
+                    }
+                }
+                if (misses == 3 || t == 0) {
+                    clusterStarts.push_back(t);
+                }
+            }
+        }
+        if (clusterStarts.size() < 2) {
+            return indices;
+        }
+        clusterStarts.push_back(triangleCount);
+
+        glm::vec3 meshCentre(0.0f);
+        for (const Vertex &vertex : vertices) {
+            meshCentre = meshCentre + vertex.Position;
+        }
+        meshCentre = meshCentre / (float)vertices.size();
+
+        struct Cluster {
+            size_t first;
+            size_t last;
+            float sortKey;
+        };
+        std::vector<Cluster> clusters;
+        clusters.reserve(clusterStarts.size() - 1);
+        for (size_t c = 0; c + 1 < clusterStarts.size(); ++c) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+                const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 weightedNormal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+                float triangleArea = glm::length(weightedNormal);
+                centroid = centroid + (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal = normal + weightedNormal;
+                area += triangleArea;
+            }
+            float key = 0.0f;
+            float normalLength = glm::length(normal);
+            if (area > 0.0f && normalLength > 0.0f) {
+                key = glm::dot(centroid / area - meshCentre, normal / normalLength);
+            }
+            clusters.push_back({ clusterStarts[c], clusterStarts[c + 1], key });
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (const Cluster &cluster : clusters) {
+            result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+        }
+        return result;
+    }
+
+    // renumbers vertices in the order the index buffer first uses them, unreferenced vertices are dropped
+    static void optimizeVertexFetch(MeshData &mesh) {
+        const unsigned int Unused = ~0u;
+        std::vector<unsigned int> remap(mesh.vertices.size(), Unused);
+        std::vector<Vertex> vertices;
+        vertices.reserve(mesh.vertices.size());
+        for (unsigned int &index : mesh.indices) {
+            if (remap[index] == Unused) {
+                remap[index] = (unsigned int)vertices.size();
+                vertices.push_back(mesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+        mesh.vertices = std::move(vertices);
+    }
+
+private:
+    static float vertexScore(int cachePosition, unsigned int liveTriangles, int cacheSize) {
+        if (liveTriangles == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // the last triangle's vertices get a fixed score so the next triangle doesn't just reuse them
+            if (cachePosition < 3) {
+                score = 0.75f;
+            } else {
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+            }
+        }
+        // favour vertices with few triangles left so they leave the cache for good
+        return score + 2.0f / std::sqrt((float)liveTriangles);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_MESHOPTIMIZER_H
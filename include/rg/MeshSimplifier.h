@@ -0,0 +1,321 @@
+#ifndef PROJECT_BASE_MESHSIMPLIFIER_H
+#define PROJECT_BASE_MESHSIMPLIFIER_H
+
+#include <learnopengl/mesh.h>
+#include <rg/MeshOptimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Quadric error edge-collapse simplifier (Garland & Heckbert) producing the coarser levels of detail of a mesh.
+// Collapses happen in position space and always move a vertex onto an existing one, so a level is just another
+// index buffer over the mesh's vertices and can share its vertex buffer. Corners whose position moves take the
+// attributes of the vertex at the new position closest to their own (UV/normal seams get stretched a little,
+// which is fine at the distances coarse levels are drawn at). Open borders are locked so no holes appear.
+// Each level aims for half the triangles of the previous one, collapsing only while the surface moves by less than
+// maxError. A level is kept if it ends up with at most MaxKeptPercent percent of the previous level's indices,
+// anything larger isn't worth its own index buffer and building stops there.
+// Safe to call from worker threads.
+class MeshSimplifier {
+public:
+    static const unsigned int MaxLevels = 3;
+    // percent of the previous level's indices a new level may keep at most
+    static const unsigned int MaxKeptPercent = 85;
+
+    // appends up to MaxLevels coarser index buffers to mesh.lods, each with about half the triangles of the previous.
+    // Stops early when a level can't get below MaxKeptPercent percent without exceeding `maxError` (relative to the
+    // mesh size).
+    static void buildLods(MeshData &mesh, float maxError = 0.05f) {
+        mesh.lods.clear();
+        const std::vector<unsigned int> *previous = &mesh.indices;
+        for (unsigned int level = 0; level < MaxLevels; ++level) {
+            size_t target = (previous->size() / 3 / 2) * 3;
+            if (target < 3 * 16) {
+                break;
+            }
+            std::vector<unsigned int> lod = simplify(mesh.vertices, *previous, target, maxError);
+            if (lod.size() > previous->size() * MaxKeptPercent / 100) {
+                break;
+            }
+            mesh.lods.push_back(MeshOptimizer::optimizeVertexCache(lod, mesh.vertices.size()));
+            previous = &mesh.lods.back();
+        }
+    }
+
+    // collapses edges in order of increasing error until at most `targetIndexCount` indices are left or the next
+    // collapse would move the surface by more than `maxError` times the mesh's bounding box diagonal
+    static std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                              size_t targetIndexCount, float maxError) {
+        // one id per distinct position, with every vertex that shares it
+        std::vector<unsigned int> positionOf(vertices.size());
+        std::vector<glm::vec3> positions;
+        std::vector<std::vector<unsigned int>> siblings;
+        {
+            struct PositionHash {
+                size_t operator()(const glm::vec3 &p) const {
+                    uint32_t bits[3];
+                    std::memcpy(bits, &p, sizeof(bits));
+                    return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+                }
+            };
+            struct PositionEqual {
+                bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+                    return a.x == b.x && a.y == b.y && a.z == b.z;
+                }
+            };
+            std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> ids;
+            ids.reserve(vertices.size());
+            for (unsigned int v = 0; v < vertices.size(); ++v) {
+                auto inserted = ids.insert({ vertices[v].Position, (unsigned int)positions.size() });
+                if (inserted.second) {
+                    positions.push_back(vertices[v].Position);
+                    siblings.emplace_back();
+                }
+                positionOf[v] = inserted.first->second;
+                siblings[positionOf[v]].push_back(v);
+            }
+        }
+        size_t positionCount = positions.size();
+
+        glm::vec3 minimum = positions[0], maximum = positions[0];
+        for (const glm::vec3 &p : positions) {
+            minimum = glm::min(minimum, p);
+            maximum = glm::max(maximum, p);
+        }
+        double maxDistance = maxError * glm::length(maximum - minimum);
+        double maxCost = maxDistance * maxDistance;
+
+        // corners keep their vertex, triangles are tracked by position
+        std::vector<unsigned int> corners(indices);
+        std::vector<Quadric> quadrics(positionCount);
+        std::vector<bool> locked(positionCount, false);
+        {
+            std::unordered_map<uint64_t, int> edgeUses;
+            for (size_t t = 0; t < corners.size(); t += 3) {
+                unsigned int p[3] = { positionOf[corners[t]], positionOf[corners[t + 1]], positionOf[corners[t + 2]] };
+                Quadric plane = Quadric::fromTriangle(positions[p[0]], positions[p[1]], positions[p[2]]);
+                for (int k = 0; k < 3; ++k) {
+                    quadrics[p[k]] += plane;
+                    unsigned int a = p[k], b = p[(k + 1) % 3];
+                    if (a != b) {
+                        ++edgeUses[edgeKey(a, b)];
+                    }
+                }
+            }
+            for (const auto &edge : edgeUses) {
+                if (edge.second == 1) {
+                    locked[(unsigned int)(edge.first >> 32)] = true;
+                    locked[(unsigned int)(edge.first & 0xffffffffu)] = true;
+                }
+            }
+        }
+
+        std::vector<unsigned int> collapseTo(positionCount);
+        std::vector<bool> touched(positionCount);
+        std::vector<unsigned int> adjacencyStart(positionCount + 1), adjacency;
+        std::vector<Collapse> collapses;
+        while (corners.size() > targetIndexCount) {
+            // position -> triangles around it
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+            for (unsigned int corner : corners) {
+                ++adjacencyStart[positionOf[corner] + 1];
+            }
+            for (size_t p = 0; p < positionCount; ++p) {
+                adjacencyStart[p + 1] += adjacencyStart[p];
+            }
+            adjacency.resize(corners.size());
+            {
+                std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+                for (size_t c = 0; c < corners.size(); ++c) {
+                    adjacency[fill[positionOf[corners[c]]]++] = (unsigned int)(c / 3);
+                }
+            }
+
+            collapses.clear();
+            for (size_t t = 0; t < corners.size(); t += 3) {
+                for (int k = 0; k < 3; ++k) {
+                    unsigned int a = positionOf[corners[t + k]], b = positionOf[corners[t + (k + 1) % 3]];
+                    if (!locked[a]) {
+                        collapses.push_back({ a, b, quadrics[a].evaluate(positions[b]) });
+                    }
+                    if (!locked[b]) {
+                        collapses.push_back({ b, a, quadrics[b].evaluate(positions[a]) });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+                return x.cost < y.cost;
+            });
+
+            for (size_t p = 0; p < positionCount; ++p) {
+                collapseTo[p] = (unsigned int)p;
+            }
+            std::fill(touched.begin(), touched.end(), false);
+            size_t removedIndices = 0, excess = corners.size() - targetIndexCount;
+            bool errorLimitReached = false;
+            for (const Collapse &collapse : collapses) {
+                if (removedIndices >= excess) {
+                    break;
+                }
+                if (collapse.cost > maxCost) {
+                    errorLimitReached = true;
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+                if (flips(collapse, corners, positionOf, positions, adjacencyStart, adjacency)) {
+                    continue;
+                }
+
+                // the triangles around `from` change shape, nothing else may collapse onto or from them this pass
+                for (unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; ++a) {
+                    unsigned int t = adjacency[a];
+                    bool degenerate = false;
+                    for (int k = 0; k < 3; ++k) {
+                        unsigned int p = positionOf[corners[t * 3 + k]];
+                        touched[p] = true;
+                        degenerate |= p == collapse.to;
+                    }
+                    if (degenerate) {
+                        removedIndices += 3;
+                    }
+                }
+                collapseTo[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+            }
+            if (removedIndices == 0) {
+                break;
+            }
+
+            // move the corners and drop the triangles that lost an edge
+            size_t kept = 0;
+            for (size_t t = 0; t < corners.size(); t += 3) {
+                unsigned int moved[3];
+                for (int k = 0; k < 3; ++k) {
+                    unsigned int corner = corners[t + k];
+                    unsigned int target = collapseTo[positionOf[corner]];
+                    moved[k] = target == positionOf[corner] ? corner : closestSibling(vertices, siblings[target], corner);
+                }
+                if (positionOf[moved[0]] == positionOf[moved[1]] || positionOf[moved[1]] == positionOf[moved[2]]
+                    || positionOf[moved[0]] == positionOf[moved[2]]) {
+                    continue;
+                }
+                corners[kept++] = moved[0];
+                corners[kept++] = moved[1];
+                corners[kept++] = moved[2];
+            }
+            corners.resize(kept);
+            if (errorLimitReached) {
+                break;
+            }
+        }
+        return corners;
+    }
+
+private:
+    // symmetric 4x4 error quadric, the sum of squared distances to a set of planes
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        static Quadric fromTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+            Quadric q;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(normal);
+            if (length == 0.0) {
+                return q;
+            }
+            double a = normal.x / length, b = normal.y / length, c = normal.z / length;
+            double d = -(a * p0.x + b * p0.y + c * p0.z);
+            q.a2 = a * a; q.ab = a * b; q.ac = a * c; q.ad = a * d;
+            q.b2 = b * b; q.bc = b * c; q.bd = b * d;
+            q.c2 = c * c; q.cd = c * d;
+            q.d2 = d * d;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric &q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            return *this;
+        }
+
+        double evaluate(const glm::vec3 &p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double error = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                         + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                         + c2 * z * z + 2 * cd * z
+                         + d2;
+            return error > 0.0 ? error : 0.0;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b) {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    // true if moving `from` onto `to` would turn one of the surviving triangles around `from` over
+    static bool flips(const Collapse &collapse, const std::vector<unsigned int> &corners, const std::vector<unsigned int> &positionOf,
+                      const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &adjacencyStart,
+                      const std::vector<unsigned int> &adjacency) {
+        for (unsigned int a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; ++a) {
+            unsigned int t = adjacency[a];
+            unsigned int p[3];
+            bool degenerate = false;
+            for (int k = 0; k < 3; ++k) {
+                p[k] = positionOf[corners[t * 3 + k]];
+                degenerate |= p[k] == collapse.to;
+            }
+            if (degenerate) {
+                continue;
+            }
+            glm::vec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            for (int k = 0; k < 3; ++k) {
+                if (p[k] == collapse.from) {
+                    p[k] = collapse.to;
+                }
+            }
+            glm::vec3 after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the vertex among `candidates` whose normal and texCoords are closest to those of `vertex`
+    static unsigned int closestSibling(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &candidates, unsigned int vertex) {
+        const Vertex &from = vertices[vertex];
+        unsigned int best = candidates[0];
+        float bestDistance = -1.0f;
+        for (unsigned int candidate : candidates) {
+            const Vertex &to = vertices[candidate];
+            glm::vec3 normal = to.Normal - from.Normal;
+            float du = to.TexCoords.x - from.TexCoords.x, dv = to.TexCoords.y - from.TexCoords.y;
+            float distance = glm::dot(normal, normal) + du * du + dv * dv;
+            if (bestDistance < 0.0f || distance < bestDistance) {
+                bestDistance = distance;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_MESHSIMPLIFIER_H
@@ -0,0 +1,91 @@
+#ifndef PROJECT_BASE_MODELLOADER_H
+#define PROJECT_BASE_MODELLOADER_H
+
+#include <learnopengl/model.h>
+#include <rg/ThreadPool.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Imports models in parallel: Assimp parsing and mesh processing (Model::import) run on a worker pool,
+// finished models are handed back through a queue and uploaded (Model::upload) on the GL thread.
+class ModelLoader {
+public:
+    explicit ModelLoader(unsigned int threads = std::thread::hardware_concurrency())
+    : m_Start(std::chrono::steady_clock::now()), m_Pool(threads) {}
+
+    // queues `model` for import from `path`; the model must outlive finish()
+    void load(Model &model, const std::string &path) {
+        ++m_Pending;
+        m_Loaded.push_back({ &model, path });
+        Model *target = &model;
+        m_Pool.submit([this, target, path] {
+            target->import(path);
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Imported.push_back(target);
+            }
+            m_Ready.notify_one();
+        });
+    }
+
+    // must be called on the GL thread: uploads models as soon as their import finishes, returns once all are uploaded
+    void finish() {
+        while (m_Pending > 0) {
+            Model *model;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Ready.wait(lock, [this] { return !m_Imported.empty(); });
+                model = m_Imported.front();
+                m_Imported.pop_front();
+            }
+            model->upload();
+            --m_Pending;
+        }
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - m_Start;
+        std::cout << "MODEL_LOADER:: loaded models on " << m_Pool.size() << " threads in "
+                  << elapsed.count() << " ms" << std::endl;
+        printMemory();
+    }
+
+    // CPU bytes still held and GPU buffer bytes of every loaded model
+    void printMemory() const {
+        size_t cpuTotal = 0, gpuTotal = 0;
+        for (const Loaded &loaded : m_Loaded) {
+            size_t cpu = loaded.model->cpuBytes(), gpu = loaded.model->gpuBytes();
+            std::cout << "MODEL_LOADER::MEMORY " << loaded.path.substr(loaded.path.find_last_of('/') + 1) << ": CPU "
+                      << cpu / 1024.0 << " KB, GPU " << gpu / 1024.0 << " KB" << std::endl;
+            cpuTotal += cpu;
+            gpuTotal += gpu;
+        }
+        std::cout << "MODEL_LOADER::MEMORY total: CPU " << cpuTotal / (1024.0 * 1024.0) << " MB, GPU "
+                  << gpuTotal / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+private:
+    struct Loaded {
+        Model *model;
+        std::string path;
+    };
+
+    std::chrono::steady_clock::time_point m_Start;
+    std::vector<Loaded> m_Loaded; // only touched on the GL thread
+    std::mutex m_Mutex;
+    std::condition_variable m_Ready;
+    std::deque<Model*> m_Imported;
+    unsigned int m_Pending = 0; // only touched on the GL thread
+    // declared last so the workers are joined before the queue they report to is destroyed
+    ThreadPool m_Pool;
+};
+
+}
+
+#endif //PROJECT_BASE_MODELLOADER_H
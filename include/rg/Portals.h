@@ -0,0 +1,324 @@
+#ifndef PROJECT_BASE_PORTALS_H
+#define PROJECT_BASE_PORTALS_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Frustum.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// Cell and portal visibility. Cells are boxes of space (rooms, storeys), portals are boxes around the openings
+// between two cells or between a cell and the outside, which is everything no cell contains. Every frame
+// beginFrame() finds the camera's cell and walks through the portals the camera can see, narrowing the view to the
+// screen rectangle of each portal it passes; a cell is visible if the walk reaches it. Objects are then visible if
+// one of the cells they overlap is, and they intersect the view narrowed to that cell.
+//
+// A box counts as overlapping a cell if it reaches into it, or if it is flat along an axis and lies on the cell's
+// boundary: the floor between two storeys belongs to both, the walls ending at it only to their own.
+// Pure visibility data, PortalsDebug draws it.
+class Portals {
+public:
+    // cells are bits of a mask, the last bit is the outside
+    static const unsigned int MaxCells = 31;
+    static const unsigned int Outside = MaxCells;
+    // portals passed in a row before the walk gives up
+    static const unsigned int MaxDepth = 8;
+
+    struct Cell {
+        std::string name;
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+    };
+
+    // between cells `from` and `to`, either of which may be Outside
+    struct Portal {
+        std::string name;
+        unsigned int from;
+        unsigned int to;
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+    };
+
+    struct Stats {
+        int cameraCell = -1; // -1 outside
+        unsigned int visibleCells = 0;
+        unsigned int portalsPassed = 0;
+    };
+
+    // when off every cell is visible
+    bool enabled = true;
+
+    Portals() = default;
+    Portals(const Portals&) = delete;
+    Portals& operator=(const Portals&) = delete;
+
+    // returns the cell number, or -1 if there are MaxCells already
+    int addCell(const std::string &name, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        if (m_Cells.size() == MaxCells) {
+            return -1;
+        }
+        m_Cells.push_back(Cell{ name, minimum, maximum });
+        return (int)m_Cells.size() - 1;
+    }
+
+    // `from` and `to` are cell numbers, -1 for the outside
+    void addPortal(const std::string &name, int from, int to, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+        m_Portals.push_back(Portal{ name, from < 0 ? Outside : (unsigned int)from, to < 0 ? Outside : (unsigned int)to, minimum, maximum });
+    }
+
+    void clear() {
+        m_Cells.clear();
+        m_Portals.clear();
+    }
+
+    // the cells the box [minimum, maximum] overlaps, the Outside bit if none
+    uint32_t cellMask(const glm::vec3 &minimum, const glm::vec3 &maximum) const {
+        uint32_t mask = 0;
+        for (unsigned int i = 0; i < m_Cells.size(); ++i) {
+            if (overlaps(minimum, maximum, m_Cells[i].minimum, m_Cells[i].maximum)) {
+                mask |= 1u << i;
+            }
+        }
+        return mask ? mask : 1u << Outside;
+    }
+
+    // the first cell containing `point`, -1 if none
+    int cellAt(const glm::vec3 &point) const {
+        for (unsigned int i = 0; i < m_Cells.size(); ++i) {
+            const Cell &cell = m_Cells[i];
+            if (glm::all(glm::greaterThanEqual(point, cell.minimum)) && glm::all(glm::lessThan(point, cell.maximum))) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    // once per frame before anything is culled; `view` is Frustum::fromMatrix(viewProjection), shared with FrustumCuller
+    void beginFrame(const glm::mat4 &viewProjection, const Frustum &view, const glm::vec3 &cameraPosition) {
+        m_Stats = Stats();
+        int camera = cellAt(cameraPosition);
+        m_Stats.cameraCell = camera;
+        if (camera < 0) {
+            camera = Outside;
+        }
+
+        for (Rect &rect : m_Rects) {
+            rect = Rect();
+        }
+        for (unsigned char &passed : m_Passed) {
+            passed = 0;
+        }
+        m_Passed.resize(m_Portals.size(), 0);
+        m_Visible = 0;
+        if (!enabled || m_Cells.empty()) {
+            m_Visible = ~0u;
+            for (Frustum &frustum : m_Frusta) {
+                frustum = view;
+            }
+            m_Stats.visibleCells = (unsigned int)m_Cells.size() + 1;
+            return;
+        }
+
+        std::vector<Step> &stack = m_Stack;
+        stack.clear();
+        stack.push_back(Step{ (unsigned int)camera, Rect::full(), 0 });
+        m_Rects[camera] = Rect::full();
+        while (!stack.empty()) {
+            Step step = stack.back();
+            stack.pop_back();
+            Frustum narrowed = step.depth == 0 ? view : step.rect.frustum(viewProjection);
+            for (unsigned int i = 0; i < m_Portals.size(); ++i) {
+                const Portal &portal = m_Portals[i];
+                if (portal.from != step.cell && portal.to != step.cell) {
+                    continue;
+                }
+                unsigned int next = portal.from == step.cell ? portal.to : portal.from;
+                if (step.depth == MaxDepth
+                    || !narrowed.intersects((portal.minimum + portal.maximum) * 0.5f, (portal.maximum - portal.minimum) * 0.5f)) {
+                    continue;
+                }
+                Rect rect = project(viewProjection, portal, cameraPosition).intersection(step.rect);
+                if (rect.empty()) {
+                    continue;
+                }
+                m_Passed[i] = 1;
+                if (m_Rects[next].contains(rect)) {
+                    continue; // seen through a wider opening already
+                }
+                m_Rects[next] = m_Rects[next].merged(rect);
+                stack.push_back(Step{ next, rect, step.depth + 1 });
+            }
+        }
+
+        for (unsigned int cell = 0; cell <= MaxCells; ++cell) {
+            if (!m_Rects[cell].empty()) {
+                m_Visible |= 1u << cell;
+                m_Frusta[cell] = m_Rects[cell].frustum(viewProjection);
+                ++m_Stats.visibleCells;
+            }
+        }
+        for (unsigned char passed : m_Passed) {
+            m_Stats.portalsPassed += passed;
+        }
+    }
+
+    // whether the box around `center` reaching `extent` can be seen through the portals
+    bool visible(const glm::vec3 &center, const glm::vec3 &extent) const {
+        uint32_t mask = cellMask(center - extent, center + extent) & m_Visible;
+        for (unsigned int cell = 0; mask; ++cell, mask >>= 1) {
+            if ((mask & 1u) && m_Frusta[cell].intersects(center, extent)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned int cellCount() const {
+        return (unsigned int)m_Cells.size();
+    }
+
+    unsigned int portalCount() const {
+        return (unsigned int)m_Portals.size();
+    }
+
+    const Cell& cell(unsigned int cell) const {
+        return m_Cells[cell];
+    }
+
+    const Portal& portal(unsigned int portal) const {
+        return m_Portals[portal];
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    // whether the last beginFrame() reached `cell`
+    bool cellVisible(unsigned int cell) const {
+        return (m_Visible >> cell) & 1u;
+    }
+
+    // whether the last beginFrame() walked through `portal`
+    bool portalPassed(unsigned int portal) const {
+        return portal < m_Passed.size() && m_Passed[portal];
+    }
+
+private:
+    // within this of a boundary counts as on it
+    static constexpr float Epsilon = 1e-3f;
+
+    // a part of the screen in normalized device coordinates, empty while left > right
+    struct Rect {
+        float left = 1.0f;
+        float right = -1.0f;
+        float bottom = 1.0f;
+        float top = -1.0f;
+
+        static Rect full() {
+            Rect rect;
+            rect.left = rect.bottom = -1.0f;
+            rect.right = rect.top = 1.0f;
+            return rect;
+        }
+
+        bool empty() const {
+            return left >= right || bottom >= top;
+        }
+
+        bool contains(const Rect &other) const {
+            return !empty() && other.left >= left && other.right <= right && other.bottom >= bottom && other.top <= top;
+        }
+
+        Rect intersection(const Rect &other) const {
+            Rect rect;
+            rect.left = std::max(left, other.left);
+            rect.right = std::min(right, other.right);
+            rect.bottom = std::max(bottom, other.bottom);
+            rect.top = std::min(top, other.top);
+            return rect;
+        }
+
+        // the smallest rectangle around both, a cell seen through two portals is drawn through either
+        Rect merged(const Rect &other) const {
+            if (empty()) {
+                return other;
+            }
+            Rect rect;
+            rect.left = std::min(left, other.left);
+            rect.right = std::max(right, other.right);
+            rect.bottom = std::min(bottom, other.bottom);
+            rect.top = std::max(top, other.top);
+            return rect;
+        }
+
+        Frustum frustum(const glm::mat4 &viewProjection) const {
+            return Frustum::fromMatrix(viewProjection, left, right, bottom, top);
+        }
+    };
+
+    struct Step {
+        unsigned int cell;
+        Rect rect;
+        unsigned int depth;
+    };
+
+    std::vector<Cell> m_Cells;
+    std::vector<Portal> m_Portals;
+    Rect m_Rects[MaxCells + 1]; // per cell, the part of the screen it is seen through
+    Frustum m_Frusta[MaxCells + 1]; // per visible cell, the view narrowed to its rectangle
+    uint32_t m_Visible = ~0u;
+    std::vector<unsigned char> m_Passed; // per portal, this frame
+    std::vector<Step> m_Stack;
+    Stats m_Stats;
+
+    // a flat axis only has to touch the cell, any other has to reach into it
+    static bool overlaps(const glm::vec3 &minimum, const glm::vec3 &maximum, const glm::vec3 &cellMinimum,
+                         const glm::vec3 &cellMaximum) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (maximum[axis] - minimum[axis] < Epsilon) {
+                if (maximum[axis] < cellMinimum[axis] - Epsilon || minimum[axis] > cellMaximum[axis] + Epsilon) {
+                    return false;
+                }
+            } else if (maximum[axis] <= cellMinimum[axis] + Epsilon || minimum[axis] >= cellMaximum[axis] - Epsilon) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the screen rectangle around the portal; the whole screen if the camera is in the portal or it reaches behind
+    // the camera, where its projection would flip
+    static Rect project(const glm::mat4 &viewProjection, const Portal &portal, const glm::vec3 &cameraPosition) {
+        glm::vec3 margin(Epsilon);
+        if (glm::all(glm::greaterThanEqual(cameraPosition, portal.minimum - margin))
+            && glm::all(glm::lessThanEqual(cameraPosition, portal.maximum + margin))) {
+            return Rect::full();
+        }
+        Rect rect;
+        rect.left = rect.bottom = 1.0f;
+        rect.right = rect.top = -1.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point((corner & 1) ? portal.maximum.x : portal.minimum.x,
+                            (corner & 2) ? portal.maximum.y : portal.minimum.y,
+                            (corner & 4) ? portal.maximum.z : portal.minimum.z);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= Epsilon) {
+                return Rect::full();
+            }
+            rect.left = std::min(rect.left, clip.x / clip.w);
+            rect.right = std::max(rect.right, clip.x / clip.w);
+            rect.bottom = std::min(rect.bottom, clip.y / clip.w);
+            rect.top = std::max(rect.top, clip.y / clip.w);
+        }
+        return rect.intersection(Rect::full());
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_PORTALS_H
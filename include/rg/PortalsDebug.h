@@ -0,0 +1,91 @@
+#ifndef PROJECT_BASE_PORTALSDEBUG_H
+#define PROJECT_BASE_PORTALSDEBUG_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <rg/GLState.h>
+#include <rg/Portals.h>
+
+#include <vector>
+
+namespace rg {
+
+// Outlines the cells and portals of a Portals as of its last beginFrame(): visible cells green, hidden ones grey,
+// portals the view passed through yellow, the others red. GL thread only.
+class PortalsDebug {
+public:
+    PortalsDebug() = default;
+    PortalsDebug(const PortalsDebug&) = delete;
+    PortalsDebug& operator=(const PortalsDebug&) = delete;
+
+    // `shader` is debug_lines, drawn on top of the depth buffer
+    void draw(const Portals &portals, const Shader &shader) {
+        std::vector<float> &lines = m_Lines;
+        lines.clear();
+        for (unsigned int i = 0; i < portals.cellCount(); ++i) {
+            const Portals::Cell &cell = portals.cell(i);
+            outline(lines, cell.minimum, cell.maximum, portals.cellVisible(i) ? glm::vec3(0.2f, 1.0f, 0.2f) : glm::vec3(0.5f));
+        }
+        for (unsigned int i = 0; i < portals.portalCount(); ++i) {
+            const Portals::Portal &portal = portals.portal(i);
+            outline(lines, portal.minimum, portal.maximum,
+                    portals.portalPassed(i) ? glm::vec3(1.0f, 1.0f, 0.2f) : glm::vec3(1.0f, 0.2f, 0.2f));
+        }
+
+        GLState &gl = GLState::instance();
+        if (!m_Vao) {
+            glGenVertexArrays(1, &m_Vao);
+            glGenBuffers(1, &m_Vbo);
+            gl.bindVertexArray(m_Vao);
+            gl.bindBuffer(GL_ARRAY_BUFFER, m_Vbo);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        }
+        gl.bindVertexArray(m_Vao);
+        gl.bindBuffer(GL_ARRAY_BUFFER, m_Vbo);
+        glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(float), lines.data(), GL_STREAM_DRAW);
+        shader.use();
+        gl.depthFunc(GL_LEQUAL);
+        glDrawArrays(GL_LINES, 0, (GLsizei)(lines.size() / 6));
+        gl.depthFunc(GL_LESS);
+    }
+
+    // must be called while the GL context is still alive
+    void destroy() {
+        GLState::instance().forgetVertexArray(m_Vao);
+        GLState::instance().forgetBuffer(m_Vbo);
+        glDeleteVertexArrays(1, &m_Vao);
+        glDeleteBuffers(1, &m_Vbo);
+        m_Vao = m_Vbo = 0;
+    }
+
+private:
+    std::vector<float> m_Lines;
+    unsigned int m_Vao = 0;
+    unsigned int m_Vbo = 0;
+
+    // the twelve edges of the box as pairs of (position, color) vertices
+    static void outline(std::vector<float> &lines, const glm::vec3 &minimum, const glm::vec3 &maximum, const glm::vec3 &color) {
+        for (int axis = 0; axis < 3; ++axis) {
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            for (int edge = 0; edge < 4; ++edge) {
+                glm::vec3 start = minimum;
+                start[u] = (edge & 1) ? maximum[u] : minimum[u];
+                start[v] = (edge & 2) ? maximum[v] : minimum[v];
+                glm::vec3 end = start;
+                end[axis] = maximum[axis];
+                for (const glm::vec3 &point : { start, end }) {
+                    lines.insert(lines.end(), { point.x, point.y, point.z, color.x, color.y, color.z });
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_PORTALSDEBUG_H
@@ -0,0 +1,391 @@
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <rg/GeometryArena.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+#include <rg/StreamBuffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+// Collects a frame's draws and issues them sorted by a 64-bit key, so program, VAO and texture binds happen once per
+// run of equal state instead of in whatever order the draws were written. From the most significant bit:
+//
+//     pass (2) | program (8) | first texture (16) | VAO (12) | depth (26)
+//
+// Program, texture and VAO fields are the low bits of the GL names, which only matters for the ordering; the binds
+// themselves always use the full names. Within a state the opaque pass goes front to back.
+//
+// With enableMultiDrawIndirect, consecutive items that carry an arena range, are drawn with the lit program and
+// share VAO, textures and index type are issued as one glMultiDrawElementsIndirect with the indirect program
+// instead. The commands and the items' model matrices and packed vertex parameters are written to the StreamBuffer,
+// the latter bound as a storage buffer the program indexes with drawOffset + gl_DrawIDARB. GL thread only.
+class RenderQueue {
+public:
+    enum Pass {
+        Opaque = 0,
+        Sky = 1 // depth writes off, drawn where nothing else was
+    };
+
+    static const unsigned int MaxTextures = 4;
+
+    struct Item {
+        const Shader *shader = nullptr;
+        unsigned int vao = 0;
+        GLenum textureTarget = GL_TEXTURE_2D;
+        unsigned int textures[MaxTextures] = {}; // bound to units 0..MaxTextures-1, 0 leaves a unit alone
+        bool setModel = true; // whether the queue sets the `model` uniform before drawing
+        glm::mat4 model = glm::mat4(1.0f);
+        // issues the draw call once program, VAO and textures are bound
+        void (*draw)(const Item &item) = nullptr;
+        const void *object = nullptr;
+        unsigned int count = 0; // meaning depends on `draw`, e.g. vertex count for drawArrays
+        // set when the item is a single arena range that the multi-draw path may merge with its neighbours,
+        // the positionScale w is 1 for PackedVertex, the positionOffset w for texture array layers (see StaticGeometry)
+        const GeometryArena::Range *range = nullptr;
+        glm::vec4 positionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+        glm::vec4 positionOffset = glm::vec4(0.0f);
+    };
+
+    // state changes of the last flush. unsortedChanges and sortedChanges count the binds the items need one by one in
+    // submission and in sorted order, so their difference is what sorting alone saves; the binds actually issued
+    // (after multi-draw merging and GLState filtering) are the *Changes fields.
+    struct Stats {
+        unsigned int items = 0;
+        unsigned int programChanges = 0;
+        unsigned int vaoChanges = 0;
+        unsigned int textureChanges = 0;
+        unsigned int unsortedChanges = 0;
+        unsigned int sortedChanges = 0;
+        unsigned int multiDraws = 0; // glMultiDrawElementsIndirect calls
+        unsigned int indirectDraws = 0; // items drawn by them
+
+        unsigned int changes() const {
+            return programChanges + vaoChanges + textureChanges;
+        }
+
+        unsigned int saved() const {
+            return unsortedChanges > sortedChanges ? unsortedChanges - sortedChanges : 0;
+        }
+    };
+
+    static RenderQueue& instance() {
+        static RenderQueue queue;
+        return queue;
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // whether the context can run the indirect program: storage buffers, multi-draw indirect and gl_DrawIDARB
+    static bool supportsMultiDrawIndirect() {
+        bool multiDraw = hasGLVersion(4, 3)
+                         || (hasGLVersion(4, 2) && hasGLExtension("GL_ARB_multi_draw_indirect")
+                             && hasGLExtension("GL_ARB_shader_storage_buffer_object"));
+        return multiDraw && hasGLExtension("GL_ARB_shader_draw_parameters");
+    }
+
+    // items drawn with `lit` that carry a range are drawn with `indirect` from now on, `load` is the GL function
+    // loader the context was set up with. Both programs must stay alive while the queue is used.
+    bool enableMultiDrawIndirect(GLADloadproc load, const Shader &lit, const Shader &indirect) {
+        m_MultiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+        if (!m_MultiDrawElementsIndirect) {
+            std::cout << "RENDER_QUEUE::MULTI_DRAW_INDIRECT_UNAVAILABLE" << std::endl;
+            return false;
+        }
+        GLint alignment = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_StorageAlignment = std::max<size_t>((size_t)alignment, 16);
+        m_LitShader = &lit;
+        m_IndirectShader = &indirect;
+        return true;
+    }
+
+    bool multiDrawIndirect() const {
+        return m_IndirectShader != nullptr;
+    }
+
+    // depth keys are distances from `cameraPosition`, quantized up to `farPlane`
+    void beginFrame(const glm::vec3 &cameraPosition, float farPlane) {
+        m_CameraPosition = cameraPosition;
+        m_FarPlane = farPlane;
+    }
+
+    // `center` is a world space point of the item used for depth ordering
+    void submit(Pass pass, const Item &item, const glm::vec3 &center) {
+        float distance = glm::length(center - m_CameraPosition) / m_FarPlane;
+        uint64_t depth = (uint64_t)(std::min(std::max(distance, 0.0f), 1.0f) * (float)DepthMask);
+
+        uint64_t key = (uint64_t)pass << 62
+                       | (uint64_t)(item.shader->ID & 0xFF) << 54
+                       | (uint64_t)(item.textures[0] & 0xFFFF) << 38
+                       | (uint64_t)(item.vao & 0xFFF) << 26
+                       | (depth & DepthMask);
+        m_Keys.push_back(Key{ key, (uint32_t)m_Items.size() });
+        m_Items.push_back(item);
+    }
+
+    // sorts and issues everything submitted since the last flush
+    void flush() {
+        m_Stats = Stats();
+        m_Stats.items = (unsigned int)m_Items.size();
+        m_Stats.unsortedChanges = countChanges(m_Keys);
+        radixSort();
+        m_Stats.sortedChanges = countChanges(m_Keys);
+        if (m_IndirectShader) {
+            buildMultiDraws();
+        }
+
+        int pass = -1;
+        size_t nextMultiDraw = 0;
+        for (size_t k = 0; k < m_Keys.size(); ++k) {
+            const Key &key = m_Keys[k];
+            const Item &item = m_Items[key.item];
+            int itemPass = (int)(key.key >> 62);
+            if (itemPass != pass) {
+                setPass(itemPass);
+                pass = itemPass;
+            }
+
+            if (nextMultiDraw < m_MultiDraws.size() && m_MultiDraws[nextMultiDraw].firstKey == k) {
+                const MultiDraw &multiDraw = m_MultiDraws[nextMultiDraw++];
+                bind(*m_IndirectShader, item);
+                static constexpr Shader::UniformName drawOffset("drawOffset");
+                m_IndirectShader->setInt(drawOffset, (int)multiDraw.firstCommand);
+                m_MultiDrawElementsIndirect(GL_TRIANGLES, item.range->indexType,
+                                            (void*)(m_CommandOffset + multiDraw.firstCommand * sizeof(DrawCommand)),
+                                            (GLsizei)multiDraw.count, 0);
+                ++m_Stats.multiDraws;
+                m_Stats.indirectDraws += multiDraw.count;
+                k += multiDraw.count - 1;
+                continue;
+            }
+
+            bind(*item.shader, item);
+            if (item.setModel) {
+                static constexpr Shader::UniformName modelUniform("model");
+                item.shader->setMat4(modelUniform, item.model);
+            }
+            item.draw(item);
+        }
+
+        setPass(Opaque);
+        m_MultiDraws.clear();
+        m_Items.clear();
+        m_Keys.clear();
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    // draws item.count vertices of the bound VAO as triangles
+    static void drawArrays(const Item &item) {
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)item.count);
+    }
+
+private:
+    static const uint64_t DepthMask = (1ull << 26) - 1;
+    // storage buffer binding of the per-draw data, the indirect program declares it with layout (binding = 0)
+    static const unsigned int DrawBinding = 0;
+
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect,
+                                                             GLsizei drawcount, GLsizei stride);
+
+    // DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // mirrors the std430 DrawData struct of the indirect program
+    struct DrawData {
+        glm::mat4 model;
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+    };
+
+    // `count` sorted keys from `firstKey` on, drawn by the commands from `firstCommand` on
+    struct MultiDraw {
+        size_t firstKey;
+        size_t count;
+        size_t firstCommand;
+    };
+
+    struct Key {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    // bound GL state while counting the changes of an order, starting from nothing bound
+    struct State {
+        unsigned int program = 0;
+        unsigned int vao = ~0u;
+        unsigned int textures2D[MaxTextures] = { ~0u, ~0u, ~0u, ~0u };
+        unsigned int texturesCube[MaxTextures] = { ~0u, ~0u, ~0u, ~0u };
+        unsigned int texturesArray[MaxTextures] = { ~0u, ~0u, ~0u, ~0u };
+
+        bool isBound(GLenum target, unsigned int unit, unsigned int texture) const {
+            const unsigned int *bound = target == GL_TEXTURE_CUBE_MAP ? texturesCube
+                                        : target == GL_TEXTURE_2D_ARRAY ? texturesArray : textures2D;
+            return bound[unit] == texture;
+        }
+
+        void bind(GLenum target, unsigned int unit, unsigned int texture) {
+            unsigned int *bound = target == GL_TEXTURE_CUBE_MAP ? texturesCube
+                                  : target == GL_TEXTURE_2D_ARRAY ? texturesArray : textures2D;
+            bound[unit] = texture;
+        }
+    };
+
+    std::vector<Item> m_Items;
+    std::vector<Key> m_Keys;
+    std::vector<Key> m_Scratch;
+    std::vector<MultiDraw> m_MultiDraws;
+    std::vector<DrawCommand> m_Commands;
+    std::vector<DrawData> m_DrawData;
+    const Shader *m_LitShader = nullptr;
+    const Shader *m_IndirectShader = nullptr;
+    MultiDrawElementsIndirectProc m_MultiDrawElementsIndirect = nullptr;
+    GLintptr m_CommandOffset = 0; // of this frame's commands in the StreamBuffer
+    size_t m_StorageAlignment = 256;
+    glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+    float m_FarPlane = 100.0f;
+    Stats m_Stats;
+
+    RenderQueue() = default;
+
+    // through the GL state cache, which also knows what the previous flush and other code left bound
+    void bind(const Shader &shader, const Item &item) {
+        GLState &gl = GLState::instance();
+        m_Stats.programChanges += gl.useProgram(shader.ID);
+        m_Stats.vaoChanges += gl.bindVertexArray(item.vao);
+        for (unsigned int unit = 0; unit < MaxTextures; ++unit) {
+            if (item.textures[unit]) {
+                m_Stats.textureChanges += gl.bindTexture(unit, item.textureTarget, item.textures[unit]);
+            }
+        }
+    }
+
+    bool isIndirect(const Item &item) const {
+        return item.range && item.shader == m_LitShader;
+    }
+
+    static bool sameBatch(const Item &a, const Item &b) {
+        return a.vao == b.vao && a.textureTarget == b.textureTarget && a.range->indexType == b.range->indexType
+               && std::equal(a.textures, a.textures + MaxTextures, b.textures);
+    }
+
+    // groups the sorted indirect items into runs, writes their commands and draw data and uploads both
+    void buildMultiDraws() {
+        m_Commands.clear();
+        m_DrawData.clear();
+        for (size_t k = 0; k < m_Keys.size(); ++k) {
+            const Item &item = m_Items[m_Keys[k].item];
+            if (!isIndirect(item)) {
+                continue;
+            }
+            if (m_MultiDraws.empty() || m_MultiDraws.back().firstKey + m_MultiDraws.back().count != k
+                || !sameBatch(m_Items[m_Keys[m_MultiDraws.back().firstKey].item], item)) {
+                m_MultiDraws.push_back(MultiDraw{ k, 0, m_Commands.size() });
+            }
+            ++m_MultiDraws.back().count;
+
+            const GeometryArena::Range &range = *item.range;
+            DrawCommand command;
+            command.count = (GLuint)range.indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = (GLuint)(range.indexOffset / GeometryArena::indexSize(range.indexType));
+            command.baseVertex = range.baseVertex;
+            command.baseInstance = 0;
+            m_Commands.push_back(command);
+            m_DrawData.push_back(DrawData{ item.model, item.positionScale, item.positionOffset });
+        }
+        if (m_Commands.empty()) {
+            return;
+        }
+
+        StreamBuffer &stream = StreamBuffer::instance();
+        StreamBuffer::Allocation commands = stream.write(m_Commands.data(), m_Commands.size() * sizeof(DrawCommand));
+        StreamBuffer::Allocation draws = stream.write(m_DrawData.data(), m_DrawData.size() * sizeof(DrawData), m_StorageAlignment);
+        if (!commands.valid() || !draws.valid()) {
+            // the items go through the per-item path this frame
+            m_MultiDraws.clear();
+            return;
+        }
+        m_CommandOffset = commands.offset;
+        GLState::instance().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+        GLState::instance().bindBufferRange(GL_SHADER_STORAGE_BUFFER, DrawBinding, draws.buffer, draws.offset, draws.size);
+    }
+
+    // least significant digit first, 8 bits at a time, skipping digits every key shares
+    void radixSort() {
+        m_Scratch.resize(m_Keys.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8) {
+            size_t offsets[256] = {};
+            for (const Key &key : m_Keys) {
+                ++offsets[(key.key >> shift) & 0xFF];
+            }
+            if (std::find(offsets, offsets + 256, m_Keys.size()) != offsets + 256) {
+                continue;
+            }
+            size_t sum = 0;
+            for (size_t &offset : offsets) {
+                size_t count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (const Key &key : m_Keys) {
+                m_Scratch[offsets[(key.key >> shift) & 0xFF]++] = key;
+            }
+            m_Keys.swap(m_Scratch);
+        }
+    }
+
+    // the binds issuing the items in the given order takes
+    unsigned int countChanges(const std::vector<Key> &order) const {
+        unsigned int changes = 0;
+        State state;
+        for (const Key &key : order) {
+            const Item &item = m_Items[key.item];
+            changes += item.shader->ID != state.program;
+            changes += item.vao != state.vao;
+            state.program = item.shader->ID;
+            state.vao = item.vao;
+            for (unsigned int unit = 0; unit < MaxTextures; ++unit) {
+                if (item.textures[unit] && !state.isBound(item.textureTarget, unit, item.textures[unit])) {
+                    state.bind(item.textureTarget, unit, item.textures[unit]);
+                    ++changes;
+                }
+            }
+        }
+        return changes;
+    }
+
+    static void setPass(int pass) {
+        GLState &gl = GLState::instance();
+        if (pass == Sky) {
+            gl.depthMask(false);
+            gl.depthFunc(GL_LEQUAL);
+        } else {
+            gl.depthMask(true);
+            gl.depthFunc(GL_LESS);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERQUEUE_H
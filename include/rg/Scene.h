@@ -0,0 +1,692 @@
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/filesystem.h>
+#include <rg/FrustumCuller.h>
+#include <rg/ModelLoader.h>
+#include <rg/RenderQueue.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Model instances and their transforms, described by a scene file (see resources/scene.txt) instead of code.
+// Nodes are kept in flat arrays in depth-first order, so every parent comes before its children and a node's
+// subtree is the contiguous range up to its subtree end. World matrices are computed once at load and after that
+// only for nodes moved with setPosition/setRotation/setScale, together with their subtrees: update() costs nothing
+// for nodes that stay put, however many there are. The same goes for the world space bounding boxes of the nodes'
+// meshes. A Bvh over them is built with the first update() and refit as nodes move; submit() culls through it
+// against the camera frustum before anything is queued, and bvh() answers spatial queries with box numbers.
+// The file also lays out the cells and portals of portals(), which the culler consults once it was given them.
+//
+// The text file is parsed once and compiled into a binary entry in resources/cache/, keyed by the text's mtime,
+// which later loads read back without parsing. GL thread only.
+class Scene {
+public:
+    // bump whenever the compiled layout changes
+    static const uint32_t Version = 2;
+
+    struct Transform {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 rotation = glm::vec3(0.0f); // degrees, applied z, then x, then y
+        glm::vec3 scale = glm::vec3(1.0f);
+    };
+
+    struct Stats {
+        unsigned int nodes = 0;
+        unsigned int dynamicNodes = 0;
+        unsigned int updated = 0; // world matrices recomputed by the last update()
+        unsigned int meshBounds = 0; // culled boxes, one per mesh, known after the first update()
+        unsigned int bvhNodes = 0;
+    };
+
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // reads the compiled form of the scene file at `path` if it is up to date, else parses the text and compiles it.
+    // Replaces what an earlier load() read, models included, which have to be loaded again with loadModels().
+    bool load(const std::string &path) {
+        int64_t mtime;
+        if (!sourceMtime(path, mtime)) {
+            std::cout << "SCENE::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        clear();
+        bool compiled = readCompiled(path, mtime);
+        if (!compiled) {
+            clear();
+            if (!parse(path)) {
+                clear();
+                return false;
+            }
+            writeCompiled(path, mtime);
+        }
+
+        m_Worlds.resize(m_Locals.size());
+        m_Queued.assign(m_Locals.size(), 0);
+        m_Renderables.clear();
+        for (unsigned int node = 0; node < m_Locals.size(); ++node) {
+            if (m_Models[node] >= 0) {
+                m_Renderables.push_back(node);
+            }
+            m_Stats.dynamicNodes += m_Dynamic[node];
+        }
+        m_Stats.nodes = (unsigned int)m_Locals.size();
+        updateRange(0, (unsigned int)m_Locals.size());
+        std::cout << "SCENE:: " << m_Stats.nodes << " nodes (" << m_Stats.dynamicNodes << " dynamic), "
+                  << m_ModelPaths.size() << " models, " << m_Portals.cellCount() << " cells, "
+                  << m_Portals.portalCount() << " portals, " << (compiled ? "compiled" : "parsed") << std::endl;
+        return true;
+    }
+
+    // queues every model of the scene on `loader`, the models are ready after loader.finish(). Models of an earlier
+    // call are dropped, so no loader may still be working on them.
+    void loadModels(ModelLoader &loader, VertexFormat format) {
+        m_ModelObjects.clear();
+        for (const std::string &path : m_ModelPaths) {
+            m_ModelObjects.emplace_back(format);
+            loader.load(m_ModelObjects.back(), FileSystem::getPath(path));
+        }
+    }
+
+    // empties the scene and releases the textures of its models; call while the GL context is still alive
+    void unload() {
+        clear();
+    }
+
+    // index of the node called `name`, -1 if there is none
+    int find(const std::string &name) const {
+        auto it = std::find(m_Names.begin(), m_Names.end(), name);
+        return it == m_Names.end() ? -1 : (int)(it - m_Names.begin());
+    }
+
+    // only dynamic nodes can be moved
+    void setPosition(unsigned int node, const glm::vec3 &position) {
+        if (movable(node) && m_Locals[node].position != position) {
+            m_Locals[node].position = position;
+            markDirty(node);
+        }
+    }
+
+    void setRotation(unsigned int node, const glm::vec3 &rotation) {
+        if (movable(node) && m_Locals[node].rotation != rotation) {
+            m_Locals[node].rotation = rotation;
+            markDirty(node);
+        }
+    }
+
+    void setScale(unsigned int node, const glm::vec3 &scale) {
+        if (movable(node) && m_Locals[node].scale != scale) {
+            m_Locals[node].scale = scale;
+            markDirty(node);
+        }
+    }
+
+    // recomputes the world matrices of the nodes moved since the last call and of everything below them.
+    // The models must be loaded by the first call, which sets up the mesh bounding boxes.
+    void update() {
+        m_Stats.updated = 0;
+        if (!m_BoxesBuilt) {
+            buildBoxes();
+        }
+        if (m_Dirty.empty()) {
+            return;
+        }
+        std::sort(m_Dirty.begin(), m_Dirty.end());
+        unsigned int covered = 0;
+        for (unsigned int node : m_Dirty) {
+            m_Queued[node] = 0;
+            // a subtree already recomputed contains every later dirty node up to its end
+            if (node >= covered) {
+                updateRange(node, m_SubtreeEnds[node]);
+                covered = m_SubtreeEnds[node];
+            }
+        }
+        m_Dirty.clear();
+    }
+
+    // one Model::Submit per node with a model, drawn with `shader`, leaving out the meshes outside the frustum
+    void submit(RenderQueue &queue, const Shader &shader) {
+        FrustumCuller::instance().cull(m_Bvh, m_Visible);
+        for (unsigned int node : m_Renderables) {
+            m_ModelObjects[m_Models[node]].Submit(queue, shader, m_Worlds[node], m_Visible.data() + m_FirstBox[node]);
+        }
+    }
+
+    const glm::mat4& world(unsigned int node) const {
+        return m_Worlds[node];
+    }
+
+    // items are mesh bounding boxes, boxNode() tells whose
+    const Bvh& bvh() const {
+        return m_Bvh;
+    }
+
+    unsigned int boxNode(unsigned int box) const {
+        return m_BoxNodes[box];
+    }
+
+    // the scene file's cells and portals, beginFrame() is up to the caller
+    Portals& portals() {
+        return m_Portals;
+    }
+
+    const Transform& local(unsigned int node) const {
+        return m_Locals[node];
+    }
+
+    bool dynamic(unsigned int node) const {
+        return m_Dynamic[node] != 0;
+    }
+
+    unsigned int nodeCount() const {
+        return (unsigned int)m_Locals.size();
+    }
+
+    unsigned int modelCount() const {
+        return (unsigned int)m_ModelNames.size();
+    }
+
+    const std::string& modelName(unsigned int model) const {
+        return m_ModelNames[model];
+    }
+
+    // valid once the models were loaded with loadModels()
+    Model& model(unsigned int model) {
+        return m_ModelObjects[model];
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+private:
+    // per node, as written to the compiled file
+    struct NodeRecord {
+        int32_t parent;
+        int32_t model;
+        uint32_t subtreeEnd;
+        uint32_t dynamic;
+        float position[3];
+        float rotation[3];
+        float scale[3];
+        uint32_t nameLength;
+    };
+
+    // per cell and portal, a cell's from and to are -1
+    struct CellRecord {
+        int32_t from;
+        int32_t to;
+        float minimum[3];
+        float maximum[3];
+        uint32_t nameLength;
+    };
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        int64_t mtime;
+        uint32_t modelCount;
+        uint32_t nodeCount;
+        uint32_t cellCount;
+        uint32_t portalCount;
+    };
+
+    // hot, touched by update() and submit()
+    std::vector<Transform> m_Locals;
+    std::vector<glm::mat4> m_Worlds;
+    std::vector<int> m_Parents;
+    std::vector<unsigned int> m_SubtreeEnds; // one past the last node below this one
+    std::vector<int> m_Models;
+    std::vector<unsigned char> m_Dynamic;
+    std::vector<unsigned int> m_Renderables;
+    std::vector<unsigned int> m_Dirty;
+    std::vector<unsigned char> m_Queued; // whether the node is in m_Dirty already
+    BoundingBoxes m_Boxes; // world space, one per mesh of every node with a model
+    std::vector<unsigned int> m_FirstBox; // per node, its meshes' boxes follow
+    std::vector<unsigned int> m_BoxNodes; // per box, the node it belongs to
+    Bvh m_Bvh;
+    std::vector<unsigned char> m_Visible; // per box, from the last submit()
+    bool m_BoxesBuilt = false;
+    Portals m_Portals;
+
+    // cold
+    std::vector<std::string> m_Names;
+    std::vector<std::string> m_ModelNames;
+    std::vector<std::string> m_ModelPaths;
+    std::deque<Model> m_ModelObjects; // a deque, so models never move once the loader points at them
+    Stats m_Stats;
+
+    void clear() {
+        m_Locals.clear();
+        m_Parents.clear();
+        m_SubtreeEnds.clear();
+        m_Models.clear();
+        m_Dynamic.clear();
+        m_Dirty.clear();
+        m_Names.clear();
+        m_ModelNames.clear();
+        m_ModelPaths.clear();
+        m_ModelObjects.clear(); // m_Models indexes the new file's models from here on
+        m_Boxes.resize(0);
+        m_FirstBox.clear();
+        m_BoxNodes.clear();
+        m_Bvh = Bvh();
+        m_BoxesBuilt = false;
+        m_Portals.clear();
+        m_Stats = Stats();
+    }
+
+    bool movable(unsigned int node) const {
+        if (!m_Dynamic[node]) {
+            std::cout << "SCENE::STATIC_NODE_MOVED " << m_Names[node] << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void markDirty(unsigned int node) {
+        if (!m_Queued[node]) {
+            m_Queued[node] = 1;
+            m_Dirty.push_back(node);
+        }
+    }
+
+    // [begin, end) must be whole subtrees, or the range from a node to its subtree end
+    void updateRange(unsigned int begin, unsigned int end) {
+        for (unsigned int node = begin; node < end; ++node) {
+            const Transform &local = m_Locals[node];
+            glm::mat4 model = m_Parents[node] >= 0 ? m_Worlds[m_Parents[node]] : glm::mat4(1.0f);
+            model = glm::translate(model, local.position);
+            model = glm::rotate(model, glm::radians(local.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::rotate(model, glm::radians(local.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+            model = glm::rotate(model, glm::radians(local.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+            m_Worlds[node] = glm::scale(model, local.scale);
+            if (m_BoxesBuilt && m_Models[node] >= 0) {
+                updateBoxes(node);
+            }
+        }
+        m_Stats.updated += end - begin;
+    }
+
+    void buildBoxes() {
+        m_FirstBox.assign(m_Locals.size(), 0);
+        m_BoxNodes.clear();
+        for (unsigned int node : m_Renderables) {
+            m_FirstBox[node] = (unsigned int)m_BoxNodes.size();
+            m_BoxNodes.insert(m_BoxNodes.end(), m_ModelObjects[m_Models[node]].meshes.size(), node);
+        }
+        m_Boxes.resize((unsigned int)m_BoxNodes.size());
+        for (unsigned int node : m_Renderables) {
+            updateBoxes(node);
+        }
+
+        std::vector<glm::vec3> minimums(m_Boxes.size()), maximums(m_Boxes.size());
+        for (unsigned int box = 0; box < m_Boxes.size(); ++box) {
+            minimums[box] = m_Boxes.minimum(box);
+            maximums[box] = m_Boxes.maximum(box);
+        }
+        m_Bvh.build(minimums, maximums);
+        m_BoxesBuilt = true;
+        m_Stats.meshBounds = m_Boxes.size();
+        m_Stats.bvhNodes = m_Bvh.nodeCount();
+    }
+
+    void updateBoxes(unsigned int node) {
+        const Model &model = m_ModelObjects[m_Models[node]];
+        for (unsigned int i = 0; i < model.meshes.size(); ++i) {
+            unsigned int box = m_FirstBox[node] + i;
+            m_Boxes.set(box, m_Worlds[node], model.meshes[i].boundsMin(), model.meshes[i].boundsMax());
+            if (m_BoxesBuilt) {
+                m_Bvh.update(box, m_Boxes.minimum(box), m_Boxes.maximum(box));
+            }
+        }
+    }
+
+    // the text form, nodes may refer to parents declared after them
+    bool parse(const std::string &path) {
+        struct ParsedNode {
+            std::string name, model, parent;
+            bool dynamic;
+            Transform local;
+            unsigned int line;
+        };
+
+        std::ifstream in(path);
+        std::vector<ParsedNode> parsed;
+        std::unordered_map<std::string, int> models, nodes, cells;
+        std::string line;
+        unsigned int lineNumber = 0;
+        while (std::getline(in, line)) {
+            ++lineNumber;
+            std::istringstream fields(line);
+            std::string kind;
+            if (!(fields >> kind) || kind[0] == '#') {
+                continue;
+            }
+            if (kind == "model") {
+                std::string name, modelPath;
+                fields >> name >> std::ws;
+                std::getline(fields, modelPath);
+                modelPath.erase(modelPath.find_last_not_of(" \t\r") + 1);
+                if (name.empty() || modelPath.empty() || !models.emplace(name, (int)m_ModelNames.size()).second) {
+                    return syntaxError(path, lineNumber, "expected a new model name and a path");
+                }
+                m_ModelNames.push_back(name);
+                m_ModelPaths.push_back(modelPath);
+            } else if (kind == "node") {
+                ParsedNode node;
+                std::string mobility;
+                Transform &t = node.local;
+                node.line = lineNumber;
+                if (!(fields >> node.name >> node.model >> node.parent >> mobility
+                             >> t.position.x >> t.position.y >> t.position.z
+                             >> t.rotation.x >> t.rotation.y >> t.rotation.z
+                             >> t.scale.x >> t.scale.y >> t.scale.z)
+                    || (mobility != "static" && mobility != "dynamic")) {
+                    return syntaxError(path, lineNumber, "expected name, model, parent, static|dynamic and 9 floats");
+                }
+                if (node.model != "-" && !models.count(node.model)) {
+                    return syntaxError(path, lineNumber, "unknown model " + node.model);
+                }
+                if (!nodes.emplace(node.name, (int)parsed.size()).second) {
+                    return syntaxError(path, lineNumber, "duplicate node " + node.name);
+                }
+                node.dynamic = mobility == "dynamic";
+                parsed.push_back(node);
+            } else if (kind == "cell") {
+                std::string name;
+                glm::vec3 minimum, maximum;
+                if (!(fields >> name >> minimum.x >> minimum.y >> minimum.z >> maximum.x >> maximum.y >> maximum.z)
+                    || !glm::all(glm::lessThan(minimum, maximum))) {
+                    return syntaxError(path, lineNumber, "expected name, minimum and maximum of a box");
+                }
+                if (cells.count(name) || name == "-") {
+                    return syntaxError(path, lineNumber, "duplicate cell " + name);
+                }
+                int cell = m_Portals.addCell(name, minimum, maximum);
+                if (cell < 0) {
+                    return syntaxError(path, lineNumber, "more than " + std::to_string(Portals::MaxCells) + " cells");
+                }
+                cells[name] = cell;
+            } else if (kind == "portal") {
+                std::string name, from, to;
+                glm::vec3 minimum, maximum;
+                if (!(fields >> name >> from >> to >> minimum.x >> minimum.y >> minimum.z >> maximum.x >> maximum.y >> maximum.z)
+                    || !glm::all(glm::lessThanEqual(minimum, maximum))) {
+                    return syntaxError(path, lineNumber, "expected name, two cells, minimum and maximum of a box");
+                }
+                for (const std::string &cell : { from, to }) {
+                    if (cell != "-" && !cells.count(cell)) {
+                        return syntaxError(path, lineNumber, "unknown cell " + cell);
+                    }
+                }
+                if (from == to) {
+                    return syntaxError(path, lineNumber, "portal " + name + " leads to the cell it starts in");
+                }
+                m_Portals.addPortal(name, from == "-" ? -1 : cells[from], to == "-" ? -1 : cells[to], minimum, maximum);
+            } else {
+                return syntaxError(path, lineNumber, "unknown entry " + kind);
+            }
+        }
+
+        std::vector<int> parents(parsed.size(), -1);
+        std::vector<std::vector<unsigned int>> children(parsed.size());
+        std::vector<unsigned int> roots;
+        for (unsigned int i = 0; i < parsed.size(); ++i) {
+            if (parsed[i].parent == "-") {
+                roots.push_back(i);
+                continue;
+            }
+            auto it = nodes.find(parsed[i].parent);
+            if (it == nodes.end()) {
+                return syntaxError(path, parsed[i].line, "unknown parent " + parsed[i].parent);
+            }
+            parents[i] = it->second;
+            children[it->second].push_back(i);
+        }
+
+        // depth-first, keeping the file's order among siblings
+        std::vector<int> order(parsed.size(), -1);
+        std::vector<unsigned int> stack(roots.rbegin(), roots.rend());
+        while (!stack.empty()) {
+            unsigned int i = stack.back();
+            stack.pop_back();
+            order[i] = (int)m_Locals.size();
+            int parent = parents[i] >= 0 ? order[parents[i]] : -1;
+            // a static node below a dynamic one would move with it
+            bool dynamic = parsed[i].dynamic || (parent >= 0 && m_Dynamic[parent]);
+            if (dynamic && !parsed[i].dynamic) {
+                std::cout << "SCENE::STATIC_BELOW_DYNAMIC " << parsed[i].name << " is made dynamic" << std::endl;
+            }
+            m_Names.push_back(parsed[i].name);
+            m_Parents.push_back(parent);
+            m_Models.push_back(parsed[i].model == "-" ? -1 : models[parsed[i].model]);
+            m_Dynamic.push_back(dynamic ? 1 : 0);
+            m_Locals.push_back(parsed[i].local);
+            stack.insert(stack.end(), children[i].rbegin(), children[i].rend());
+        }
+        if (m_Locals.size() != parsed.size()) {
+            for (unsigned int i = 0; i < parsed.size(); ++i) {
+                if (order[i] < 0) {
+                    return syntaxError(path, parsed[i].line, "node " + parsed[i].name + " is its own ancestor");
+                }
+            }
+        }
+
+        // children follow their parent directly, so walking backwards every subtree is complete when its root is reached
+        m_SubtreeEnds.resize(m_Locals.size());
+        for (unsigned int node = (unsigned int)m_Locals.size(); node-- > 0;) {
+            m_SubtreeEnds[node] = std::max(m_SubtreeEnds[node], node + 1);
+            if (m_Parents[node] >= 0) {
+                m_SubtreeEnds[m_Parents[node]] = std::max(m_SubtreeEnds[m_Parents[node]], m_SubtreeEnds[node]);
+            }
+        }
+        return true;
+    }
+
+    static bool syntaxError(const std::string &path, unsigned int line, const std::string &message) {
+        std::cout << "SCENE::SYNTAX_ERROR " << path << ":" << line << ": " << message << std::endl;
+        return false;
+    }
+
+    // the compiled form: header, models as (name, path) pairs, nodes in depth-first order, cells, portals
+    bool readCompiled(const std::string &path, int64_t mtime) {
+        std::ifstream in(entryPath(path), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t offset = 0;
+        auto take = [&](void *target, size_t n) {
+            if (n > data.size() - offset) {
+                return false;
+            }
+            std::memcpy(target, data.data() + offset, n);
+            offset += n;
+            return true;
+        };
+        auto takeString = [&](std::string &s, uint32_t length) {
+            if (length > data.size() - offset) {
+                return false;
+            }
+            s.assign(data.data() + offset, length);
+            offset += length;
+            return true;
+        };
+
+        FileHeader header;
+        if (!take(&header, sizeof(header)) || std::memcmp(header.magic, "RGSC", 4) != 0
+            || header.version != Version || header.mtime != mtime) {
+            return false;
+        }
+        for (uint32_t i = 0; i < header.modelCount; ++i) {
+            uint32_t lengths[2];
+            std::string name, modelPath;
+            if (!take(lengths, sizeof(lengths)) || !takeString(name, lengths[0]) || !takeString(modelPath, lengths[1])) {
+                return false;
+            }
+            m_ModelNames.push_back(name);
+            m_ModelPaths.push_back(modelPath);
+        }
+        for (uint32_t i = 0; i < header.nodeCount; ++i) {
+            NodeRecord record;
+            std::string name;
+            if (!take(&record, sizeof(record)) || !takeString(name, record.nameLength)
+                || record.parent < -1 || record.parent >= (int32_t)i || record.model < -1
+                || record.model >= (int32_t)header.modelCount || record.subtreeEnd <= i
+                || record.subtreeEnd > header.nodeCount) {
+                return false;
+            }
+            Transform local;
+            local.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+            local.rotation = glm::vec3(record.rotation[0], record.rotation[1], record.rotation[2]);
+            local.scale = glm::vec3(record.scale[0], record.scale[1], record.scale[2]);
+            m_Names.push_back(name);
+            m_Parents.push_back(record.parent);
+            m_SubtreeEnds.push_back(record.subtreeEnd);
+            m_Models.push_back(record.model);
+            m_Dynamic.push_back(record.dynamic ? 1 : 0);
+            m_Locals.push_back(local);
+        }
+        // depth-first order: a node's parent is the innermost subtree still open at it, and its subtree ends inside
+        std::vector<unsigned int> open;
+        for (unsigned int node = 0; node < m_Parents.size(); ++node) {
+            while (!open.empty() && m_SubtreeEnds[open.back()] <= node) {
+                open.pop_back();
+            }
+            if (m_Parents[node] != (open.empty() ? -1 : (int)open.back())
+                || (!open.empty() && m_SubtreeEnds[node] > m_SubtreeEnds[open.back()])) {
+                return false;
+            }
+            open.push_back(node);
+        }
+        for (uint32_t i = 0; i < header.cellCount + header.portalCount; ++i) {
+            CellRecord record;
+            std::string name;
+            if (!take(&record, sizeof(record)) || !takeString(name, record.nameLength)
+                || record.from < -1 || record.from >= (int32_t)header.cellCount
+                || record.to < -1 || record.to >= (int32_t)header.cellCount) {
+                return false;
+            }
+            glm::vec3 minimum(record.minimum[0], record.minimum[1], record.minimum[2]);
+            glm::vec3 maximum(record.maximum[0], record.maximum[1], record.maximum[2]);
+            if (i < header.cellCount) {
+                if (m_Portals.addCell(name, minimum, maximum) < 0) {
+                    return false;
+                }
+            } else {
+                m_Portals.addPortal(name, record.from, record.to, minimum, maximum);
+            }
+        }
+        return offset == data.size();
+    }
+
+    void writeCompiled(const std::string &path, int64_t mtime) const {
+        std::string dir = FileSystem::getPath("resources/cache");
+        mkdir(dir.c_str(), 0755);
+        std::string file = entryPath(path);
+        std::string tmp = file + ".tmp";
+
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "SCENE::WRITE_FAILED " << file << std::endl;
+            return;
+        }
+        FileHeader header;
+        std::memcpy(header.magic, "RGSC", 4);
+        header.version = Version;
+        header.mtime = mtime;
+        header.modelCount = (uint32_t)m_ModelNames.size();
+        header.nodeCount = (uint32_t)m_Locals.size();
+        header.cellCount = m_Portals.cellCount();
+        header.portalCount = m_Portals.portalCount();
+        out.write((const char*)&header, sizeof(header));
+        for (size_t i = 0; i < m_ModelNames.size(); ++i) {
+            uint32_t lengths[2] = { (uint32_t)m_ModelNames[i].size(), (uint32_t)m_ModelPaths[i].size() };
+            out.write((const char*)lengths, sizeof(lengths));
+            out.write(m_ModelNames[i].data(), m_ModelNames[i].size());
+            out.write(m_ModelPaths[i].data(), m_ModelPaths[i].size());
+        }
+        for (size_t i = 0; i < m_Locals.size(); ++i) {
+            const Transform &local = m_Locals[i];
+            NodeRecord record = {
+                    m_Parents[i], m_Models[i], m_SubtreeEnds[i], m_Dynamic[i],
+                    { local.position.x, local.position.y, local.position.z },
+                    { local.rotation.x, local.rotation.y, local.rotation.z },
+                    { local.scale.x, local.scale.y, local.scale.z },
+                    (uint32_t)m_Names[i].size()
+            };
+            out.write((const char*)&record, sizeof(record));
+            out.write(m_Names[i].data(), m_Names[i].size());
+        }
+        auto writeBox = [&](const std::string &name, int from, int to, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+            CellRecord record = {
+                    from, to,
+                    { minimum.x, minimum.y, minimum.z },
+                    { maximum.x, maximum.y, maximum.z },
+                    (uint32_t)name.size()
+            };
+            out.write((const char*)&record, sizeof(record));
+            out.write(name.data(), name.size());
+        };
+        for (unsigned int i = 0; i < m_Portals.cellCount(); ++i) {
+            const Portals::Cell &cell = m_Portals.cell(i);
+            writeBox(cell.name, -1, -1, cell.minimum, cell.maximum);
+        }
+        for (unsigned int i = 0; i < m_Portals.portalCount(); ++i) {
+            const Portals::Portal &portal = m_Portals.portal(i);
+            auto cellNumber = [](unsigned int cell) {
+                return cell == Portals::Outside ? -1 : (int)cell;
+            };
+            writeBox(portal.name, cellNumber(portal.from), cellNumber(portal.to), portal.minimum, portal.maximum);
+        }
+
+        out.close();
+        if (!out || std::rename(tmp.c_str(), file.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            std::cout << "SCENE::WRITE_FAILED " << file << std::endl;
+        }
+    }
+
+    static bool sourceMtime(const std::string &path, int64_t &mtime) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        mtime = (int64_t)st.st_mtime;
+        return true;
+    }
+
+    // FNV-1a of the source path, like the mesh cache
+    static std::string entryPath(const std::string &path) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.rgscene", (unsigned long long)hash);
+        return FileSystem::getPath("resources/cache/") + name;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SCENE_H
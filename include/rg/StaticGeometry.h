@@ -0,0 +1,313 @@
+#ifndef PROJECT_BASE_STATICGEOMETRY_H
+#define PROJECT_BASE_STATICGEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/FrustumCuller.h>
+#include <rg/GeometryArena.h>
+#include <rg/Portals.h>
+#include <rg/RenderQueue.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace rg {
+
+// Geometry that never moves, baked once at startup. Every added shape is transformed into world space and
+// merged into one vertex and one index buffer, grouped by texture, so it takes one glDrawElements per texture
+// with an identity model matrix. Shapes are non-indexed triangle lists of interleaved position, normal
+// and texture coordinates (8 floats), identical corners of a shape are welded while baking.
+//
+// With setTextureArray the textures passed to add() are layers of that array instead. The layer is then baked
+// into every vertex (attribute LayerAttribute) and the geometry is grouped by CellSize cells of space instead,
+// one draw per cell under the same binding, which the multi-draw path issues as one call. The
+// shader samples the array while the `layeredMaterial` uniform is set, or on the multi-draw path while the
+// draw's positionOffset.w is. Groups whose bounding box is outside the camera frustum are not submitted.
+// With setCells the groups are also split by the Portals cells their triangles lie in, so the culler can hide a whole
+// storey instead of keeping every group that reaches into a visible one. GL thread only.
+class StaticGeometry {
+public:
+    static const unsigned int FloatsPerVertex = 8;
+    // clear of Mesh and InstanceBatch attributes, so unbaked geometry reads the default 0
+    static const unsigned int LayerAttribute = 9;
+    // texture unit the array is bound to, units 0 and 1 stay the 2D material samplers
+    static const unsigned int LayerUnit = 2;
+    // edge of the cells a texture array geometry is split into for culling
+    static constexpr float CellSize = 8.0f;
+
+    struct Shape {
+        const float *vertices;
+        unsigned int vertexCount;
+    };
+
+    // of the last bake()
+    struct Stats {
+        unsigned int shapes = 0;
+        unsigned int vertices = 0;
+        unsigned int draws = 0;
+    };
+
+    StaticGeometry() = default;
+    StaticGeometry(const StaticGeometry&) = delete;
+    StaticGeometry& operator=(const StaticGeometry&) = delete;
+
+    // the vertices of `shape` must stay alive until bake()
+    void add(const Shape &shape, unsigned int texture, const glm::mat4 &model) {
+        m_Parts.push_back(Part{ shape, texture, model });
+    }
+
+    // triangles that are already in world space
+    void add(unsigned int texture, std::vector<float> vertices) {
+        m_Owned.push_back(std::move(vertices));
+        Shape shape = { m_Owned.back().data(), (unsigned int)(m_Owned.back().size() / FloatsPerVertex) };
+        add(shape, texture, glm::mat4(1.0f));
+    }
+
+    // call before bake(), `textureArray` is a GL_TEXTURE_2D_ARRAY
+    void setTextureArray(unsigned int textureArray) {
+        m_TextureArray = textureArray;
+    }
+
+    // call before bake(), `portals` only has to stay alive until then
+    void setCells(const Portals &portals) {
+        m_Cells = &portals;
+    }
+
+    void bake() {
+        // triangles are grouped by texture (or cell), keeping the order they were added in within a group
+        std::vector<float> vertices;
+        std::map<uint64_t, Bucket> buckets;
+        std::vector<unsigned int> unique, remap;
+        const float *welded = nullptr;
+        for (const Part &part : m_Parts) {
+            if (part.shape.vertices != welded) {
+                weld(part.shape, unique, remap);
+                welded = part.shape.vertices;
+            }
+
+            unsigned int base = (unsigned int)(vertices.size() / BakedFloats);
+            glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(part.model)));
+            for (unsigned int source : unique) {
+                const float *v = part.shape.vertices + source * FloatsPerVertex;
+                glm::vec3 position = glm::vec3(part.model * glm::vec4(v[0], v[1], v[2], 1.0f));
+                glm::vec3 normal = glm::normalize(normalMatrix * glm::vec3(v[3], v[4], v[5]));
+                float layer = m_TextureArray ? (float)part.texture : 0.0f;
+                float baked[BakedFloats] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, v[6], v[7], layer };
+                vertices.insert(vertices.end(), baked, baked + BakedFloats);
+            }
+            for (unsigned int i = 0; i + 2 < part.shape.vertexCount; i += 3) {
+                glm::vec3 corners[3];
+                for (unsigned int c = 0; c < 3; ++c) {
+                    const float *v = vertices.data() + (size_t)(base + remap[i + c]) * BakedFloats;
+                    corners[c] = glm::vec3(v[0], v[1], v[2]);
+                }
+                Bucket &bucket = buckets[groupKey(part.texture, corners)];
+                bucket.texture = part.texture;
+                for (unsigned int c = 0; c < 3; ++c) {
+                    bucket.minimum = glm::min(bucket.minimum, corners[c]);
+                    bucket.maximum = glm::max(bucket.maximum, corners[c]);
+                    bucket.indices.push_back(base + remap[i + c]);
+                }
+            }
+        }
+
+        std::vector<unsigned int> indices;
+        for (const auto &entry : buckets) {
+            const Bucket &bucket = entry.second;
+            Group group;
+            group.texture = bucket.texture;
+            group.range.indexOffset = indices.size(); // in indices until upload() knows the index type
+            group.range.indexCount = (unsigned int)bucket.indices.size();
+            group.center = (bucket.minimum + bucket.maximum) * 0.5f;
+            m_Groups.push_back(group);
+            m_Boxes.add(group.center, (bucket.maximum - bucket.minimum) * 0.5f);
+            indices.insert(indices.end(), bucket.indices.begin(), bucket.indices.end());
+        }
+        upload(vertices, indices);
+        m_Stats.shapes = (unsigned int)m_Parts.size();
+        m_Stats.vertices = (unsigned int)(vertices.size() / BakedFloats);
+        m_Stats.draws = (unsigned int)m_Groups.size();
+        std::vector<Part>().swap(m_Parts);
+        m_Owned.clear();
+        m_Cells = nullptr;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    void printStats() const {
+        std::cout << "STATIC_GEOMETRY:: " << m_Stats.shapes << " shapes baked into " << m_Stats.vertices << " vertices, "
+                  << m_Stats.draws << " draws" << std::endl;
+    }
+
+    // one queue item per texture (or per cell with a texture array) inside the frustum, drawn with `shader`
+    void submit(RenderQueue &queue, const Shader &shader) {
+        FrustumCuller::instance().cull(m_Boxes, m_Visible);
+        for (const Group &group : m_Groups) {
+            if (!m_Visible[&group - m_Groups.data()]) {
+                continue;
+            }
+            RenderQueue::Item item;
+            item.shader = &shader;
+            item.vao = m_Vao;
+            if (m_TextureArray) {
+                item.textureTarget = GL_TEXTURE_2D_ARRAY;
+                item.textures[LayerUnit] = m_TextureArray;
+                item.positionOffset.w = 1.0f;
+            } else {
+                item.textures[0] = group.texture;
+            }
+            item.draw = drawQueued;
+            item.object = this;
+            item.count = (unsigned int)(&group - m_Groups.data());
+            item.range = &group.range;
+            queue.submit(RenderQueue::Opaque, item, group.center);
+        }
+    }
+
+    // must be called while the GL context is still alive
+    void destroy() {
+        glDeleteVertexArrays(1, &m_Vao);
+        glDeleteBuffers(1, &m_Vbo);
+        glDeleteBuffers(1, &m_Ebo);
+        m_Vao = m_Vbo = m_Ebo = 0;
+        m_Groups.clear();
+        m_Boxes.resize(0);
+    }
+
+private:
+    // FloatsPerVertex plus the texture array layer
+    static const unsigned int BakedFloats = FloatsPerVertex + 1;
+
+    struct Part {
+        Shape shape;
+        unsigned int texture;
+        glm::mat4 model;
+    };
+
+    // the triangles of one group while baking
+    struct Bucket {
+        unsigned int texture = 0;
+        std::vector<unsigned int> indices;
+        glm::vec3 minimum = glm::vec3(1e30f);
+        glm::vec3 maximum = glm::vec3(-1e30f);
+    };
+
+    struct Group {
+        unsigned int texture = 0;
+        GeometryArena::Range range; // base vertex 0, in the buffers of m_Vao
+        glm::vec3 center = glm::vec3(0.0f); // of the group's bounding box, for depth ordering
+    };
+
+    std::vector<Part> m_Parts;
+    std::deque<std::vector<float>> m_Owned; // a deque, so shapes can point into its elements
+    std::vector<Group> m_Groups;
+    BoundingBoxes m_Boxes; // per group
+    std::vector<unsigned char> m_Visible; // per group, from the last submit()
+    unsigned int m_Vao = 0;
+    unsigned int m_Vbo = 0;
+    unsigned int m_Ebo = 0;
+    unsigned int m_TextureArray = 0;
+    const Portals *m_Cells = nullptr;
+    Stats m_Stats;
+
+    // the texture, or with a texture array the CellSize cell containing the triangle's center, 10 bits per cell
+    // coordinate (8192 units along each axis); above them the mask of the Portals cells the triangle lies in
+    uint64_t groupKey(unsigned int texture, const glm::vec3 (&corners)[3]) const {
+        uint64_t key = texture;
+        if (m_TextureArray) {
+            glm::vec3 center = (corners[0] + corners[1] + corners[2]) / 3.0f;
+            key = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                int cell = (int)std::floor(center[axis] / CellSize) + (1 << 9);
+                key = (key << 10) | (uint64_t)(cell & 0x3FF);
+            }
+        }
+        if (m_Cells) {
+            glm::vec3 minimum = glm::min(glm::min(corners[0], corners[1]), corners[2]);
+            glm::vec3 maximum = glm::max(glm::max(corners[0], corners[1]), corners[2]);
+            key |= (uint64_t)m_Cells->cellMask(minimum, maximum) << 32;
+        }
+        return key;
+    }
+
+    static void drawQueued(const RenderQueue::Item &item) {
+        static constexpr Shader::UniformName layeredMaterial("layeredMaterial");
+        const StaticGeometry &geometry = *(const StaticGeometry*)item.object;
+        if (geometry.m_TextureArray) {
+            item.shader->setBool(layeredMaterial, true);
+        }
+        GeometryArena::draw(geometry.m_Groups[item.count].range);
+        // the same shader also draws the 2D textured meshes
+        if (geometry.m_TextureArray) {
+            item.shader->setBool(layeredMaterial, false);
+        }
+    }
+
+    // unique: the first of every set of identical vertices, remap[i]: position of vertex i's set in unique
+    static void weld(const Shape &shape, std::vector<unsigned int> &unique, std::vector<unsigned int> &remap) {
+        unique.clear();
+        remap.resize(shape.vertexCount);
+        for (unsigned int i = 0; i < shape.vertexCount; ++i) {
+            remap[i] = (unsigned int)unique.size();
+            for (unsigned int j = 0; j < unique.size(); ++j) {
+                if (std::memcmp(shape.vertices + i * FloatsPerVertex, shape.vertices + unique[j] * FloatsPerVertex,
+                                FloatsPerVertex * sizeof(float)) == 0) {
+                    remap[i] = j;
+                    break;
+                }
+            }
+            if (remap[i] == unique.size()) {
+                unique.push_back(i);
+            }
+        }
+    }
+
+    void upload(const std::vector<float> &vertices, const std::vector<unsigned int> &indices) {
+        glGenVertexArrays(1, &m_Vao);
+        glGenBuffers(1, &m_Vbo);
+        glGenBuffers(1, &m_Ebo);
+        glBindVertexArray(m_Vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_Vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, BakedFloats * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, BakedFloats * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, BakedFloats * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(LayerAttribute);
+        glVertexAttribPointer(LayerAttribute, 1, GL_FLOAT, GL_FALSE, BakedFloats * sizeof(float), (void*)(8 * sizeof(float)));
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Ebo);
+        GLenum indexType = GL_UNSIGNED_INT;
+        if (vertices.size() / BakedFloats <= 65536) {
+            std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            indexType = GL_UNSIGNED_SHORT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        }
+        for (Group &group : m_Groups) {
+            group.range.vao = m_Vao;
+            group.range.indexType = indexType;
+            group.range.indexOffset *= GeometryArena::indexSize(indexType);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_STATICGEOMETRY_H
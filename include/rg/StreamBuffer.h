@@ -0,0 +1,195 @@
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <glad/glad.h>
+
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace rg {
+
+// One buffer all per-frame data is streamed through: uniform blocks, draw commands and per-draw storage. Each
+// frame's writes are sub-allocated linearly and bound with glBindBufferRange (or used as an offset), so nothing is
+// reallocated and no write waits for the GPU.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistently and coherently, and split into
+// FrameCount regions; a frame writes only its own region after waiting on the fence placed when the region was
+// last used, three frames ago. Without it the whole buffer is orphaned at the start of every frame and written
+// with glBufferSubData. GL thread only.
+class StreamBuffer {
+public:
+    static const unsigned int FrameCount = 3;
+
+    // where written data ended up, `offset` is in bytes from the start of `buffer`
+    struct Allocation {
+        unsigned int buffer = 0;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+
+        bool valid() const {
+            return buffer != 0;
+        }
+    };
+
+    struct Stats {
+        size_t bytes = 0; // written this frame
+        unsigned int waits = 0; // frames that had to wait for the GPU to release their region, since startup
+    };
+
+    static StreamBuffer& instance() {
+        static StreamBuffer buffer;
+        return buffer;
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // `frameSize` bytes per frame, `load` is the GL function loader the context was set up with
+    void init(GLADloadproc load, size_t frameSize = 1u << 20) {
+        m_FrameSize = frameSize;
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_UniformAlignment = std::max<size_t>((size_t)alignment, 16);
+
+        if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+            m_BufferStorage = (BufferStorageProc)load("glBufferStorage");
+        }
+
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+        if (m_BufferStorage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            m_BufferStorage(GL_COPY_WRITE_BUFFER, m_FrameSize * FrameCount, nullptr, flags);
+            m_Mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_FrameSize * FrameCount, flags);
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, m_FrameSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        std::cout << "STREAM_BUFFER:: " << (m_Mapped ? "persistently mapped, " : "orphaned every frame, ")
+                  << m_FrameSize / 1024 << " KB per frame" << std::endl;
+    }
+
+    // once per frame before anything is written
+    void beginFrame() {
+        m_Frame = (m_Frame + 1) % FrameCount;
+        m_Stats.bytes = 0;
+        m_Overflowed = false;
+        if (m_Mapped) {
+            waitFor(m_Fences[m_Frame]);
+            m_Cursor = m_Frame * m_FrameSize;
+            m_End = m_Cursor + m_FrameSize;
+        } else {
+            GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, m_FrameSize, nullptr, GL_STREAM_DRAW);
+            m_Cursor = 0;
+            m_End = m_FrameSize;
+        }
+    }
+
+    // once per frame after the last draw reading this frame's data
+    void endFrame() {
+        if (m_Mapped) {
+            m_Fences[m_Frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+
+    // copies `size` bytes into this frame's part of the buffer at a multiple of `alignment`.
+    // Returns an invalid allocation if the frame is out of space.
+    Allocation write(const void *data, size_t size, size_t alignment = 16) {
+        size_t offset = (m_Cursor + alignment - 1) / alignment * alignment;
+        if (offset + size > m_End) {
+            if (!m_Overflowed) {
+                std::cout << "STREAM_BUFFER::OUT_OF_SPACE " << size << " bytes requested, "
+                          << m_End - std::min(offset, m_End) << " left this frame" << std::endl;
+                m_Overflowed = true;
+            }
+            return Allocation();
+        }
+
+        if (m_Mapped) {
+            std::memcpy(m_Mapped + offset, data, size);
+        } else {
+            GLState::instance().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        }
+        m_Cursor = offset + size;
+        m_Stats.bytes += size;
+
+        Allocation allocation;
+        allocation.buffer = m_Buffer;
+        allocation.offset = (GLintptr)offset;
+        allocation.size = (GLsizeiptr)size;
+        return allocation;
+    }
+
+    // for data bound with glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    size_t uniformAlignment() const {
+        return m_UniformAlignment;
+    }
+
+    bool persistent() const {
+        return m_Mapped != nullptr;
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    // must be called while the GL context is still alive
+    void shutdown() {
+        for (GLsync &fence : m_Fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        if (m_Mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            m_Mapped = nullptr;
+        }
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+
+private:
+    typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+    unsigned int m_Buffer = 0;
+    BufferStorageProc m_BufferStorage = nullptr;
+    unsigned char *m_Mapped = nullptr;
+    GLsync m_Fences[FrameCount] = {};
+    size_t m_FrameSize = 0;
+    size_t m_UniformAlignment = 256;
+    unsigned int m_Frame = 0;
+    size_t m_Cursor = 0;
+    size_t m_End = 0;
+    bool m_Overflowed = false;
+    Stats m_Stats;
+
+    StreamBuffer() = default;
+
+    void waitFor(GLsync &fence) {
+        if (!fence) {
+            return;
+        }
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            ++m_Stats.waits;
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
@@ -0,0 +1,72 @@
+#ifndef PROJECT_BASE_TEXTUREARRAY_H
+#define PROJECT_BASE_TEXTUREARRAY_H
+
+#include <glad/glad.h>
+#include <rg/GLState.h>
+#include <rg/TextureService.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Packs material images into the layers of one GL_TEXTURE_2D_ARRAY, so geometry using any of them is drawn under a
+// single texture binding with the layer passed along per vertex. Every layer has the array's size. load() hands the
+// images to TextureService, whose workers take them block-compressed from the TextureCache (resampled to the array's
+// size when they are first transcoded) and upload them in the background. GL thread only.
+class TextureArray {
+public:
+    explicit TextureArray(int size = 1024)
+            : m_Size(size) {
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    // the layer the image at `path` ends up in, adding the same path twice gives the same layer
+    unsigned int add(const std::string &path) {
+        auto it = m_Layers.find(path);
+        if (it != m_Layers.end()) {
+            return it->second;
+        }
+        unsigned int layer = (unsigned int)m_Paths.size();
+        m_Paths.push_back(path);
+        m_Layers.emplace(path, layer);
+        return layer;
+    }
+
+    // requests every added image, returns the GL texture. It samples as mid grey until all layers are uploaded.
+    unsigned int load() {
+        m_Handle = TextureService::instance().loadArray(m_Paths, m_Size);
+        return m_Handle.id();
+    }
+
+    unsigned int id() const {
+        return m_Handle.id();
+    }
+
+    unsigned int layerCount() const {
+        return (unsigned int)m_Paths.size();
+    }
+
+    // must be called while the GL context is still alive
+    void destroy() {
+        unsigned int id = m_Handle.id();
+        if (id) {
+            glDeleteTextures(1, &id);
+            GLState::instance().forgetTexture(id);
+        }
+        m_Handle = TextureHandle();
+    }
+
+private:
+    int m_Size;
+    TextureHandle m_Handle;
+    std::vector<std::string> m_Paths;
+    std::unordered_map<std::string, unsigned int> m_Layers;
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTUREARRAY_H
@@ -0,0 +1,323 @@
+#ifndef PROJECT_BASE_TEXTURECACHE_H
+#define PROJECT_BASE_TEXTURECACHE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <learnopengl/filesystem.h>
+#include <rg/BlockCompression.h>
+#include <rg/GLExtensions.h>
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+// A texture image transcoded to a GPU block format, with its whole mip chain.
+struct CompressedImage {
+    struct Level {
+        int width;
+        int height;
+        size_t offset;
+        size_t size;
+    };
+
+    GLenum format = 0;
+    std::vector<Level> levels;
+    std::vector<uint8_t> data; // all levels back to back
+};
+
+// First-run transcoder and cache for block-compressed textures. Each source image is decoded once, mip-mapped and
+// encoded to BC1/BC3/BC4/BC5/BC7 on the CPU, then stored as a KTX 1.1 file under resources/cache/textures.
+// Later runs read the KTX and upload it with glCompressedTexImage2D: no image decode and no mip generation.
+// Entries are keyed by source path, its mtime and size, the target format, the resampled size and the encoder version.
+class TextureCache {
+public:
+    // bump whenever an encoder changes so stale entries get re-transcoded
+    static const uint32_t EncoderVersion = 1;
+
+    // block formats the current context can sample, queried once on the GL thread
+    struct Caps {
+        bool s3tc = false;
+        bool bptc = false;
+
+        static Caps query() {
+            Caps caps;
+            caps.s3tc = hasGLExtension("GL_EXT_texture_compression_s3tc");
+            caps.bptc = hasGLVersion(4, 2) || hasGLExtension("GL_ARB_texture_compression_bptc");
+            return caps;
+        }
+    };
+
+    struct Stats {
+        std::atomic<unsigned int> hits{0};
+        std::atomic<unsigned int> transcodes{0};
+        std::atomic<unsigned long long> compressedBytes{0};
+        std::atomic<unsigned long long> uncompressedBytes{0}; // what the same images cost as RGBA8 with mips
+    };
+
+    // picks the block format for an image with `channels` channels, 0 if it has to stay uncompressed.
+    // Normal maps keep only X and Y in BC5.
+    static GLenum chooseFormat(int channels, bool normalMap, const Caps &caps) {
+        if (normalMap || channels == 1) {
+            return normalMap ? GL_COMPRESSED_RG_RGTC2 : GL_COMPRESSED_RED_RGTC1;
+        }
+        if (channels == 3) {
+            return caps.s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+        }
+        if (caps.bptc) {
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+        return caps.s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+    }
+
+    // fills `image` from the cache entry of `path`, transcoding and writing the entry first if it is missing or stale.
+    // A `size` other than 0 scales the image to size x size before encoding (texture array layers).
+    // Safe to call from worker threads.
+    static bool load(const std::string &path, GLenum format, bool mipmaps, CompressedImage &image, int size = 0) {
+        std::string key;
+        if (!sourceKey(path, format, mipmaps, size, key)) {
+            return false;
+        }
+        std::string file = entryPath(path, format, mipmaps, size);
+
+        if (read(file, key, format, image)) {
+            ++stats().hits;
+        } else {
+            if (!transcode(path, format, mipmaps, size, image)) {
+                return false;
+            }
+            write(file, key, image);
+            ++stats().transcodes;
+        }
+
+        stats().compressedBytes += image.data.size();
+        const CompressedImage::Level &base = image.levels.front();
+        unsigned long long rgba = (unsigned long long)base.width * base.height * 4;
+        stats().uncompressedBytes += image.levels.size() > 1 ? rgba * 4 / 3 : rgba;
+        return true;
+    }
+
+    static Stats& stats() {
+        static Stats s;
+        return s;
+    }
+
+    static void printStats() {
+        const Stats &s = stats();
+        unsigned long long compressed = s.compressedBytes, uncompressed = s.uncompressedBytes;
+        std::cout << "TEXTURE_CACHE:: " << s.hits << " hits, " << s.transcodes << " transcoded, "
+                  << compressed / (1024.0 * 1024.0) << " MB in VRAM instead of " << uncompressed / (1024.0 * 1024.0)
+                  << " MB (" << (compressed ? (double)uncompressed / compressed : 0.0) << "x)" << std::endl;
+    }
+
+private:
+    static bc::Format blockFormat(GLenum format) {
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return bc::BC1;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return bc::BC3;
+            case GL_COMPRESSED_RED_RGTC1: return bc::BC4;
+            case GL_COMPRESSED_RG_RGTC2: return bc::BC5;
+            default: return bc::BC7;
+        }
+    }
+
+    static GLenum baseFormat(GLenum format) {
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return GL_RGB;
+            case GL_COMPRESSED_RED_RGTC1: return GL_RED;
+            case GL_COMPRESSED_RG_RGTC2: return GL_RG;
+            default: return GL_RGBA;
+        }
+    }
+
+    static bool sourceKey(const std::string &path, GLenum format, bool mipmaps, int size, std::string &key) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        key = path + '|' + std::to_string((long long)st.st_mtime) + '|' + std::to_string((long long)st.st_size) + '|'
+            + std::to_string(format) + '|' + (mipmaps ? "mips" : "base") + '|' + std::to_string(size) + '|'
+            + std::to_string(EncoderVersion);
+        return true;
+    }
+
+    static std::string entryPath(const std::string &path, GLenum format, bool mipmaps, int size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[64];
+        if (size) {
+            std::snprintf(name, sizeof(name), "%016llx_%04x%s_%d.ktx", (unsigned long long)hash, format, mipmaps ? "m" : "",
+                          size);
+        } else {
+            std::snprintf(name, sizeof(name), "%016llx_%04x%s.ktx", (unsigned long long)hash, format, mipmaps ? "m" : "");
+        }
+        return FileSystem::getPath("resources/cache/textures/") + name;
+    }
+
+    static bool transcode(const std::string &path, GLenum format, bool mipmaps, int size, CompressedImage &image) {
+        int width, height, channels;
+        std::unique_ptr<unsigned char, void(*)(void*)> pixels(stbi_load(path.c_str(), &width, &height, &channels, 4),
+                                                             stbi_image_free);
+        if (!pixels) {
+            return false;
+        }
+
+        bc::Format block = blockFormat(format);
+        image.format = format;
+        image.levels.clear();
+        image.data.clear();
+
+        std::vector<uint8_t> level;
+        const uint8_t *rgba = pixels.get();
+        if (size && (width != size || height != size)) {
+            level = bc::resample(rgba, width, height, size);
+            rgba = level.data();
+            width = height = size;
+        }
+        for (;;) {
+            size_t offset = image.data.size();
+            bc::encodeImage(block, rgba, width, height, image.data);
+            image.levels.push_back({ width, height, offset, image.data.size() - offset });
+            if (!mipmaps || (width == 1 && height == 1)) {
+                break;
+            }
+            level = bc::downsample(rgba, width, height);
+            rgba = level.data();
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return true;
+    }
+
+    // KTX 1.1 header, https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+    struct KtxHeader {
+        uint8_t identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    static const uint8_t* ktxIdentifier() {
+        static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+        return identifier;
+    }
+
+    static std::string keyValueData(const std::string &key) {
+        std::string pair = std::string("rg.source") + '\0' + key + '\0';
+        uint32_t size = (uint32_t)pair.size();
+        std::string data((const char*)&size, sizeof(size));
+        data += pair;
+        data.resize((data.size() + 3) & ~(size_t)3, '\0');
+        return data;
+    }
+
+    static void write(const std::string &file, const std::string &key, const CompressedImage &image) {
+        mkdir(FileSystem::getPath("resources/cache").c_str(), 0755);
+        mkdir(FileSystem::getPath("resources/cache/textures").c_str(), 0755);
+
+        std::string keyValues = keyValueData(key);
+        KtxHeader header;
+        std::memcpy(header.identifier, ktxIdentifier(), 12);
+        header.endianness = 0x04030201;
+        header.glType = 0;
+        header.glTypeSize = 1;
+        header.glFormat = 0;
+        header.glInternalFormat = image.format;
+        header.glBaseInternalFormat = baseFormat(image.format);
+        header.pixelWidth = (uint32_t)image.levels.front().width;
+        header.pixelHeight = (uint32_t)image.levels.front().height;
+        header.pixelDepth = 0;
+        header.numberOfArrayElements = 0;
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = (uint32_t)image.levels.size();
+        header.bytesOfKeyValueData = (uint32_t)keyValues.size();
+
+        // the same image may be transcoded by two workers at once, so each writer gets its own temporary
+        static std::atomic<unsigned int> writers{0};
+        std::string tmp = file + ".tmp" + std::to_string(writers++);
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write(keyValues.data(), keyValues.size());
+        // block sizes are multiples of 8 bytes, so no level needs mip padding
+        for (const CompressedImage::Level &level : image.levels) {
+            uint32_t size = (uint32_t)level.size;
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)&image.data[level.offset], level.size);
+        }
+        out.close();
+        if (!out || std::rename(tmp.c_str(), file.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            std::cout << "TEXTURE_CACHE::WRITE_FAILED " << file << std::endl;
+        }
+    }
+
+    static bool read(const std::string &file, const std::string &key, GLenum format, CompressedImage &image) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        KtxHeader header;
+        if (bytes.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        std::string keyValues = keyValueData(key);
+        if (std::memcmp(header.identifier, ktxIdentifier(), 12) != 0 || header.endianness != 0x04030201
+            || header.glInternalFormat != format || header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0
+            || header.bytesOfKeyValueData != keyValues.size() || bytes.size() < sizeof(header) + keyValues.size()
+            || std::memcmp(&bytes[sizeof(header)], keyValues.data(), keyValues.size()) != 0) {
+            return false;
+        }
+
+        image.format = format;
+        image.levels.clear();
+        image.data.clear();
+        size_t offset = sizeof(header) + keyValues.size();
+        int width = (int)header.pixelWidth, height = (int)header.pixelHeight;
+        for (uint32_t i = 0; i < header.numberOfMipmapLevels; ++i) {
+            uint32_t size;
+            if (bytes.size() - offset < sizeof(size)) {
+                return false;
+            }
+            std::memcpy(&size, &bytes[offset], sizeof(size));
+            offset += sizeof(size);
+            if (bytes.size() - offset < size || size != bc::compressedSize(blockFormat(format), width, height)) {
+                return false;
+            }
+            image.levels.push_back({ width, height, image.data.size(), size });
+            image.data.insert(image.data.end(), bytes.begin() + offset, bytes.begin() + offset + size);
+            offset += size;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTURECACHE_H
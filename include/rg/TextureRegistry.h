@@ -0,0 +1,284 @@
+#ifndef PROJECT_BASE_TEXTUREREGISTRY_H
+#define PROJECT_BASE_TEXTUREREGISTRY_H
+
+#include <glad/glad.h>
+#include <rg/GLState.h>
+#include <rg/TextureService.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+// Process-wide table of every texture the scene uses. Textures are looked up by canonical path, and once the
+// TextureService worker has read them, by a hash of the file contents: the same image shipped under several names
+// (every model folder has its own copy of Wooden_Chair_default.png) ends up as one texture. The first copy to finish
+// loading is kept, later ones give up their storage when they finish and their names become aliases of it; holders of
+// a texture name refresh it with resolve() whenever generation() changed. Entries are reference counted, the GL
+// texture and the names merged into it are deleted by collect() once the last reference is released and the service
+// is done with it.
+// GL thread only.
+class TextureRegistry {
+public:
+    struct Stats {
+        unsigned int requests = 0;
+        unsigned int pathHits = 0;
+        unsigned int contentHits = 0;
+        unsigned long long bytesSaved = 0; // uploaded size of the textures that didn't have to be kept twice
+    };
+
+    static TextureRegistry& instance() {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    unsigned int acquire2D(const std::string &path, bool normalMap = false) {
+        // normal maps are encoded differently, so they don't share an entry with the same image used as colour
+        return acquire(normalMap ? Kind::NormalMap : Kind::Color, std::vector<std::string>{ path });
+    }
+
+    unsigned int acquireCubemap(const std::vector<std::string> &faces) {
+        return acquire(Kind::Cubemap, faces);
+    }
+
+    // drops one reference to `id`; the texture is deleted by the next collect() once it is unreferenced and loaded
+    void release(unsigned int id) {
+        id = resolve(id);
+        auto it = m_Entries.find(id);
+        if (it == m_Entries.end()) {
+            return;
+        }
+        Entry &entry = it->second;
+        if (--entry.refs > 0) {
+            return;
+        }
+
+        for (const std::string &path : entry.paths) {
+            m_ByPath.erase(path);
+        }
+        if (entry.contentHash) {
+            m_ByContent.erase(entry.contentHash);
+        }
+        // every holder of a merged name released it through resolve(), so nothing uses those names anymore
+        for (unsigned int merged : entry.merged) {
+            m_Aliases.erase(merged);
+        }
+        m_Retired.insert(m_Retired.end(), entry.merged.begin(), entry.merged.end());
+        m_Pending.erase(std::remove(m_Pending.begin(), m_Pending.end(), id), m_Pending.end());
+        m_Unreferenced.push_back(entry.handle);
+        m_Entries.erase(it);
+    }
+
+    // once per frame after TextureService::update(): merges the textures that finished loading into the ones with the
+    // same contents, and deletes released textures
+    void update() {
+        bool pending = !m_Pending.empty();
+        for (size_t i = 0; i < m_Pending.size();) {
+            Entry &entry = m_Entries[m_Pending[i]];
+            if (!entry.handle.loaded()) {
+                ++i;
+                continue;
+            }
+            unsigned int id = m_Pending[i];
+            m_Pending[i] = m_Pending.back();
+            m_Pending.pop_back();
+
+            entry.bytes = entry.handle.bytes();
+            m_Stats.bytesSaved += entry.bytes * entry.pathHits;
+            if (!entry.handle.contentHash()) {
+                continue; // failed, not worth deduplicating
+            }
+            uint64_t contentHash = hashCombine(entry.handle.contentHash(), (uint64_t)entry.kind);
+            auto byContent = m_ByContent.find(contentHash);
+            if (byContent == m_ByContent.end()) {
+                entry.contentHash = contentHash;
+                m_ByContent[contentHash] = id;
+            } else {
+                merge(id, byContent->second);
+            }
+        }
+        // the content hits are only known once everything requested so far has loaded
+        if (pending && m_Pending.empty()) {
+            printStats();
+        }
+        collect();
+    }
+
+    // the texture `id` stands for now, different from `id` once it was merged into an identical one
+    unsigned int resolve(unsigned int id) const {
+        auto alias = m_Aliases.find(id);
+        return alias == m_Aliases.end() ? id : alias->second;
+    }
+
+    // changes whenever a texture becomes an alias
+    unsigned int generation() const {
+        return m_Generation;
+    }
+
+    // deletes the released textures the service is done with
+    void collect() {
+        for (unsigned int id : m_Retired) {
+            deleteTexture(id);
+        }
+        m_Retired.clear();
+        for (size_t i = 0; i < m_Unreferenced.size();) {
+            if (m_Unreferenced[i].loaded()) {
+                deleteTexture(m_Unreferenced[i].id());
+                m_Unreferenced[i] = m_Unreferenced.back();
+                m_Unreferenced.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    // deletes every released texture, loaded or not; must be called while the GL context is still alive and after
+    // the holders released theirs
+    void shutdown() {
+        for (const TextureHandle &handle : m_Unreferenced) {
+            deleteTexture(handle.id());
+        }
+        m_Unreferenced.clear();
+        for (unsigned int id : m_Retired) {
+            deleteTexture(id);
+        }
+        m_Retired.clear();
+        if (!m_Entries.empty()) {
+            std::cout << "TEXTURE_REGISTRY::STILL_REFERENCED " << m_Entries.size() << " textures" << std::endl;
+        }
+    }
+
+    const Stats& stats() const {
+        return m_Stats;
+    }
+
+    void printStats() const {
+        std::cout << "TEXTURE_REGISTRY:: " << m_Stats.requests << " requests, " << m_Entries.size() << " unique textures, "
+                  << m_Stats.pathHits << " path hits, " << m_Stats.contentHits << " content hits, "
+                  << m_Stats.bytesSaved / (1024.0 * 1024.0) << " MB of duplicate uploads saved" << std::endl;
+    }
+
+private:
+    enum class Kind { Color, NormalMap, Cubemap };
+
+    struct Entry {
+        TextureHandle handle;
+        Kind kind = Kind::Color;
+        unsigned int refs = 0;
+        unsigned int pathHits = 0; // while loading, counted into the saved bytes once the size is known
+        uint64_t contentHash = 0;  // 0 until loaded
+        size_t bytes = 0;
+        std::vector<std::string> paths; // every path key that resolves to this entry
+        std::vector<unsigned int> merged; // names of the duplicates merged into this entry, see merge()
+    };
+
+    std::unordered_map<unsigned int, Entry> m_Entries; // by GL texture name
+    std::unordered_map<std::string, unsigned int> m_ByPath;
+    std::unordered_map<uint64_t, unsigned int> m_ByContent;
+    std::unordered_map<unsigned int, unsigned int> m_Aliases; // merged duplicate -> the texture it was merged into
+    std::vector<unsigned int> m_Pending; // still loading, content unknown
+    std::vector<TextureHandle> m_Unreferenced; // released, deleted once loaded
+    std::vector<unsigned int> m_Retired; // merged names whose entry was released, deleted by collect()
+    unsigned int m_Generation = 0;
+    Stats m_Stats;
+
+    TextureRegistry() = default;
+
+    unsigned int acquire(Kind kind, const std::vector<std::string> &paths) {
+        ++m_Stats.requests;
+
+        std::string pathKey = std::to_string((int)kind);
+        for (const std::string &path : paths) {
+            pathKey += '|' + canonicalPath(path);
+        }
+        auto byPath = m_ByPath.find(pathKey);
+        if (byPath != m_ByPath.end()) {
+            ++m_Stats.pathHits;
+            Entry &entry = m_Entries[byPath->second];
+            ++entry.refs;
+            if (entry.handle.loaded()) {
+                m_Stats.bytesSaved += entry.bytes;
+            } else {
+                ++entry.pathHits;
+            }
+            return byPath->second;
+        }
+
+        TextureService &service = TextureService::instance();
+        TextureHandle handle = kind == Kind::Cubemap ? service.loadCubemap(paths)
+                                                     : service.load2D(paths.front(), kind == Kind::NormalMap);
+        Entry &entry = m_Entries[handle.id()];
+        entry.handle = handle;
+        entry.kind = kind;
+        entry.refs = 1;
+        entry.paths.push_back(pathKey);
+        m_ByPath[pathKey] = handle.id();
+        m_Pending.push_back(handle.id());
+        return handle.id();
+    }
+
+    // `duplicate` finished loading with the contents of `original`: its references and paths move over. Holders may
+    // keep using the name `duplicate` until they next resolve() it, so the name stays reserved (and its alias valid)
+    // until `original` is released; only its storage is given back now. Deleting it here would let glGenTextures hand
+    // the same name to another texture while it still resolves to `original`.
+    void merge(unsigned int duplicate, unsigned int original) {
+        Entry &from = m_Entries[duplicate];
+        Entry &to = m_Entries[original];
+        ++m_Stats.contentHits;
+        m_Stats.bytesSaved += from.bytes;
+        to.refs += from.refs;
+        for (const std::string &path : from.paths) {
+            m_ByPath[path] = original;
+            to.paths.push_back(path);
+        }
+        m_Aliases[duplicate] = original;
+        ++m_Generation;
+        freeStorage(from);
+        to.merged.push_back(duplicate);
+        to.merged.insert(to.merged.end(), from.merged.begin(), from.merged.end());
+        m_Entries.erase(duplicate);
+    }
+
+    // replaces every level with an empty image, the name keeps existing
+    static void freeStorage(const Entry &entry) {
+        bool cubemap = entry.kind == Kind::Cubemap;
+        GLState::instance().bindTexture(0, cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D, entry.handle.id());
+        for (unsigned int face = 0; face < (cubemap ? 6u : 1u); ++face) {
+            GLenum target = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+            for (unsigned int level = 0; level < entry.handle.levels(); ++level) {
+                glTexImage2D(target, (GLint)level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+    }
+
+    static void deleteTexture(unsigned int id) {
+        glDeleteTextures(1, &id);
+        GLState::instance().forgetTexture(id);
+    }
+
+    static std::string canonicalPath(const std::string &path) {
+        char resolved[PATH_MAX];
+        return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+    }
+
+    static uint64_t hashCombine(uint64_t hash, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTUREREGISTRY_H
@@ -0,0 +1,466 @@
+#ifndef PROJECT_BASE_TEXTURESERVICE_H
+#define PROJECT_BASE_TEXTURESERVICE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <rg/BlockCompression.h>
+#include <rg/GLState.h>
+#include <rg/TextureCache.h>
+#include <rg/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+class TextureService;
+
+// Returned immediately by TextureService. id() is a valid GL texture name right away: it samples as a
+// 1x1 placeholder until the real image has been uploaded into the same texture object.
+class TextureHandle {
+public:
+    TextureHandle() = default;
+
+    unsigned int id() const {
+        return m_Request ? m_Request->id : 0;
+    }
+
+    bool resident() const {
+        return m_Request && m_Request->resident;
+    }
+
+    // resident, or failed and left as the placeholder for good
+    bool loaded() const {
+        return m_Request && m_Request->loaded;
+    }
+
+    // FNV-1a of the source files' bytes, valid once loaded(); 0 if the texture failed
+    uint64_t contentHash() const {
+        return m_Request ? m_Request->contentHash : 0;
+    }
+
+    // bytes the decoded images took to upload, valid once loaded()
+    size_t bytes() const {
+        return m_Request ? m_Request->bytes : 0;
+    }
+
+    // mip levels the texture was specified with, valid once resident()
+    unsigned int levels() const {
+        return m_Request ? m_Request->levels : 0;
+    }
+
+private:
+    friend class TextureService;
+
+    struct StbiDeleter {
+        void operator()(unsigned char *pixels) const {
+            stbi_image_free(pixels);
+        }
+    };
+
+    struct Image {
+        std::string path;
+        uint64_t contentHash = 0;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        std::unique_ptr<unsigned char, StbiDeleter> pixels; // uncompressed fallback
+        std::vector<unsigned char> resampled;               // replaces pixels for array layers of another size
+        CompressedImage compressed;                         // used when compressed.format != 0
+
+        const unsigned char* data() const {
+            if (compressed.format) {
+                return compressed.data.data();
+            }
+            return pixels ? pixels.get() : resampled.data();
+        }
+
+        size_t uploadSize() const {
+            return compressed.format ? compressed.data.size() : (size_t)width * height * channels;
+        }
+    };
+
+    struct Request {
+        unsigned int id = 0;
+        GLenum target = GL_TEXTURE_2D;
+        bool mipmaps = true;
+        bool normalMap = false;
+        int size = 0;                      // layer size of GL_TEXTURE_2D_ARRAY requests
+        TextureCache::Caps caps;
+        std::vector<Image> images;         // one per face or layer
+        std::atomic<int> pendingDecodes{0};
+        std::atomic<bool> failed{false};
+        uint64_t contentHash = 0;          // written by the last worker before the request is handed over
+        bool resident = false;             // GL thread only
+        bool loaded = false;               // GL thread only
+        size_t bytes = 0;                  // GL thread only
+        unsigned int levels = 0;           // GL thread only
+    };
+
+    std::shared_ptr<Request> m_Request;
+
+    explicit TextureHandle(std::shared_ptr<Request> request) : m_Request(std::move(request)) {}
+};
+
+// Loads textures on worker threads and streams them to the GPU through a ring of pixel buffer objects.
+// Workers fetch the block-compressed version of each image from the TextureCache (transcoding it on the first run)
+// and only fall back to plain stbi decoding when the context can't sample the needed block format.
+// update() has to be called on the GL thread (once per frame); it uploads at most `uploadBudget` bytes
+// per call so large images don't stall a single frame.
+class TextureService {
+public:
+    static const unsigned int PboCount = 3;
+
+    static TextureService& instance() {
+        static TextureService service;
+        return service;
+    }
+
+    TextureService(const TextureService&) = delete;
+    TextureService& operator=(const TextureService&) = delete;
+
+    // repeat-wrapped, mipmapped 2D texture, as used by the scene and model materials
+    TextureHandle load2D(const std::string &path, bool normalMap = false) {
+        return request(GL_TEXTURE_2D, std::vector<std::string>{ path }, true, normalMap);
+    }
+
+    // clamped cube map without mips, faces in +X, -X, +Y, -Y, +Z, -Z order
+    TextureHandle loadCubemap(const std::vector<std::string> &faces) {
+        return request(GL_TEXTURE_CUBE_MAP, faces, false, false);
+    }
+
+    // repeat-wrapped, mipmapped array with one size x size layer per path. The layers share a block format and are
+    // sampled as colour only, so their alpha is dropped. A layer that fails leaves the whole array as the placeholder.
+    TextureHandle loadArray(const std::vector<std::string> &layers, int size) {
+        return request(GL_TEXTURE_2D_ARRAY, layers, true, false, size);
+    }
+
+    // uploads loaded textures through the PBO ring, returns the number of textures that became resident
+    unsigned int update(size_t uploadBudget = 16u << 20) {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            while (!m_Decoded.empty()) {
+                m_Uploading.push_back(std::move(m_Decoded.front()));
+                m_Decoded.pop_front();
+            }
+        }
+
+        unsigned int completed = 0;
+        size_t uploaded = 0;
+        while (!m_Uploading.empty()) {
+            TextureHandle::Request &request = *m_Uploading.front();
+            if (request.failed) {
+                // keeps sampling as the placeholder
+                request.images.clear();
+                request.contentHash = 0;
+                request.loaded = true;
+                --m_Outstanding;
+                m_Uploading.pop_front();
+                continue;
+            }
+
+            // the first texture always goes through, later ones only while there is budget left
+            size_t size = 0;
+            for (const TextureHandle::Image &image : request.images) {
+                size += image.uploadSize();
+            }
+            if (uploaded > 0 && uploaded + size > uploadBudget) {
+                break;
+            }
+            if (!upload(request, size)) {
+                break;
+            }
+            uploaded += size;
+
+            request.resident = true;
+            request.loaded = true;
+            request.bytes = size;
+            request.images.clear();
+            --m_Outstanding;
+            m_Uploading.pop_front();
+            ++completed;
+        }
+
+        if (completed > 0 && m_Outstanding == 0) {
+            TextureCache::printStats();
+        }
+        return completed;
+    }
+
+    // releases the PBO ring, must be called while the GL context is still alive
+    void shutdown() {
+        for (Pbo &pbo : m_Pbos) {
+            if (pbo.fence) {
+                glDeleteSync(pbo.fence);
+            }
+            if (pbo.buffer) {
+                glDeleteBuffers(1, &pbo.buffer);
+            }
+            pbo = Pbo();
+        }
+    }
+
+private:
+    struct Pbo {
+        unsigned int buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    std::mutex m_Mutex;
+    std::deque<std::shared_ptr<TextureHandle::Request>> m_Decoded;   // guarded by m_Mutex
+    std::deque<std::shared_ptr<TextureHandle::Request>> m_Uploading; // GL thread only
+    unsigned int m_Outstanding = 0;                                  // GL thread only
+    Pbo m_Pbos[PboCount];
+    unsigned int m_NextPbo = 0;
+    bool m_CapsQueried = false;
+    TextureCache::Caps m_Caps;
+    // declared last so the workers are joined before the queue they report to is destroyed
+    ThreadPool m_Decoders;
+
+    TextureService() = default;
+
+    TextureHandle request(GLenum target, const std::vector<std::string> &paths, bool mipmaps, bool normalMap, int size = 0) {
+        if (!m_CapsQueried) {
+            m_Caps = TextureCache::Caps::query();
+            m_CapsQueried = true;
+        }
+
+        auto request = std::make_shared<TextureHandle::Request>();
+        request->target = target;
+        request->mipmaps = mipmaps;
+        request->normalMap = normalMap;
+        request->size = size;
+        request->caps = m_Caps;
+        request->images.resize(paths.size());
+        request->pendingDecodes = (int)paths.size();
+
+        glGenTextures(1, &request->id);
+        uploadPlaceholder(*request);
+
+        ++m_Outstanding;
+        for (unsigned int i = 0; i < paths.size(); ++i) {
+            request->images[i].path = paths[i];
+            m_Decoders.submit([this, request, i] { decode(request, i); });
+        }
+        return TextureHandle(request);
+    }
+
+    // worker thread: loads one face and hands the request over once all of its faces are loaded. The source file is
+    // read once, for its content hash (TextureRegistry merges identical images by it) and the image header.
+    void decode(const std::shared_ptr<TextureHandle::Request> &request, unsigned int face) {
+        TextureHandle::Image &image = request->images[face];
+        std::ifstream in(image.path, std::ios::binary);
+        std::vector<unsigned char> source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        image.contentHash = hashBytes(source);
+        int width, height, channels;
+        GLenum format = 0;
+        if (!source.empty() && stbi_info_from_memory(source.data(), (int)source.size(), &width, &height, &channels)) {
+            // array layers all get the RGB format, whatever their own channels
+            format = TextureCache::chooseFormat(request->size ? 3 : channels, request->normalMap, request->caps);
+        }
+
+        if (!format || !TextureCache::load(image.path, format, request->mipmaps, image.compressed, request->size)) {
+            image.compressed = CompressedImage();
+            if (!source.empty()) {
+                // array layers are uploaded as one RGBA block, so they need the same layout
+                image.pixels.reset(stbi_load_from_memory(source.data(), (int)source.size(), &image.width, &image.height,
+                                                         &image.channels, request->size ? 4 : 0));
+            }
+            if (!image.pixels) {
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+                request->failed = true;
+            } else if (request->size) {
+                image.channels = 4;
+                if (image.width != request->size || image.height != request->size) {
+                    image.resampled = bc::resample(image.pixels.get(), image.width, image.height, request->size);
+                    image.pixels.reset();
+                    image.width = image.height = request->size;
+                }
+            }
+        }
+
+        // the decrement orders every face's hash before the last worker's read
+        if (--request->pendingDecodes == 0) {
+            for (const TextureHandle::Image &layer : request->images) {
+                if (request->size && layer.compressed.format != request->images.front().compressed.format) {
+                    // a layer fell back to uncompressed while the others were transcoded, they can't share storage
+                    request->failed = true;
+                }
+            }
+            uint64_t hash = 14695981039346656037ull;
+            for (const TextureHandle::Image &decoded : request->images) {
+                for (int i = 0; i < 8; ++i) {
+                    hash = (hash ^ ((decoded.contentHash >> (i * 8)) & 0xff)) * 1099511628211ull;
+                }
+            }
+            request->contentHash = request->failed ? 0 : hash;
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Decoded.push_back(request);
+        }
+    }
+
+    // FNV-1a
+    static uint64_t hashBytes(const std::vector<unsigned char> &bytes) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char byte : bytes) {
+            hash = (hash ^ byte) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    void uploadPlaceholder(const TextureHandle::Request &request) {
+        static const unsigned char grey[4] = { 128, 128, 128, 255 };
+        GLState::instance().bindTexture(0, request.target, request.id);
+        if (request.target == GL_TEXTURE_2D_ARRAY) {
+            std::vector<unsigned char> layers(request.images.size() * 4, 128);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, 1, 1, (GLsizei)request.images.size(), 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, layers.data());
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        } else if (request.target == GL_TEXTURE_CUBE_MAP) {
+            for (unsigned int i = 0; i < 6; ++i) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+            }
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+    }
+
+    static GLenum formatFor(int channels) {
+        switch (channels) {
+            case 1: return GL_RED;
+            case 2: return GL_RG;
+            case 3: return GL_RGB;
+            default: return GL_RGBA;
+        }
+    }
+
+    // copies every face (and every compressed mip level) of the request into the next PBO of the ring and
+    // specifies the texture images from it. Returns false without uploading if that PBO is still being read by the GPU.
+    bool upload(TextureHandle::Request &request, size_t size) {
+        Pbo &pbo = m_Pbos[m_NextPbo];
+        if (pbo.fence) {
+            if (glClientWaitSync(pbo.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                return false;
+            }
+            glDeleteSync(pbo.fence);
+            pbo.fence = nullptr;
+        }
+
+        if (!pbo.buffer) {
+            glGenBuffers(1, &pbo.buffer);
+        }
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.buffer);
+        if (pbo.capacity < size) {
+            pbo.capacity = std::max(size, pbo.capacity * 2);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, pbo.capacity, nullptr, GL_STREAM_DRAW);
+        }
+        unsigned char *dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!dst) {
+            GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        const TextureHandle::Image &first = request.images.front();
+        bool array = request.target == GL_TEXTURE_2D_ARRAY;
+        std::vector<size_t> offsets;
+        size_t offset = 0;
+        if (array && first.compressed.format) {
+            // level by level, so the layers of a level are back to back for glCompressedTexImage3D
+            for (unsigned int l = 0; l < first.compressed.levels.size(); ++l) {
+                offsets.push_back(offset);
+                for (const TextureHandle::Image &image : request.images) {
+                    const CompressedImage::Level &level = image.compressed.levels[l];
+                    std::memcpy(dst + offset, image.data() + level.offset, level.size);
+                    offset += level.size;
+                }
+            }
+        } else {
+            for (const TextureHandle::Image &image : request.images) {
+                offsets.push_back(offset);
+                std::memcpy(dst + offset, image.data(), image.uploadSize());
+                offset += image.uploadSize();
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GLState::instance().bindTexture(0, request.target, request.id);
+        int maxLevel = 0;
+        GLsizei layers = (GLsizei)request.images.size();
+        if (array && first.compressed.format) {
+            for (unsigned int l = 0; l < first.compressed.levels.size(); ++l) {
+                const CompressedImage::Level &level = first.compressed.levels[l];
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, first.compressed.format, level.width, level.height, layers,
+                                       0, (GLsizei)(level.size * layers), (void*)offsets[l]);
+            }
+            maxLevel = (int)first.compressed.levels.size() - 1;
+        } else if (array) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, first.width, first.height, layers, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, (void*)offsets[0]);
+        } else {
+            for (unsigned int i = 0; i < request.images.size(); ++i) {
+                const TextureHandle::Image &image = request.images[i];
+                GLenum face = request.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : GL_TEXTURE_2D;
+                if (image.compressed.format) {
+                    for (unsigned int l = 0; l < image.compressed.levels.size(); ++l) {
+                        const CompressedImage::Level &level = image.compressed.levels[l];
+                        glCompressedTexImage2D(face, l, image.compressed.format, level.width, level.height, 0,
+                                               (GLsizei)level.size, (void*)(offsets[i] + level.offset));
+                    }
+                    maxLevel = (int)image.compressed.levels.size() - 1;
+                } else {
+                    GLenum format = formatFor(image.channels);
+                    GLenum internalFormat = request.target == GL_TEXTURE_CUBE_MAP ? GL_RGB : format;
+                    glTexImage2D(face, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                                 (void*)offsets[i]);
+                }
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // later glTexImage2D calls with client memory must not read from the PBO
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        request.levels = 1;
+        if (first.compressed.format) {
+            // the cached mip chain is complete, nothing to generate
+            glTexParameteri(request.target, GL_TEXTURE_MAX_LEVEL, maxLevel);
+            request.levels = maxLevel + 1;
+        } else if (request.mipmaps) {
+            glGenerateMipmap(request.target);
+            for (int extent = std::max(first.width, first.height); extent > 1; extent /= 2) {
+                ++request.levels;
+            }
+        }
+
+        pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_NextPbo = (m_NextPbo + 1) % PboCount;
+        return true;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TEXTURESERVICE_H
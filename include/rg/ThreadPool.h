@@ -0,0 +1,92 @@
+#ifndef PROJECT_BASE_THREADPOOL_H
+#define PROJECT_BASE_THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg {
+
+// Fixed set of worker threads pulling jobs from a shared FIFO queue.
+// Jobs still queued when the pool is destroyed are run before the workers exit.
+// Jobs are type-erased by hand rather than with std::function, which clashes with
+// the global `function` in main.cpp because of the `using namespace std` in the learnopengl headers.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency()) {
+        threads = std::max(threads, 1u);
+        for (unsigned int i = 0; i < threads; ++i) {
+            m_Workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Wake.notify_all();
+        for (std::thread &worker : m_Workers) {
+            worker.join();
+        }
+    }
+
+    template<typename F>
+    void submit(F job) {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Jobs.emplace_back(new CallableJob<F>(std::move(job)));
+        }
+        m_Wake.notify_one();
+    }
+
+    unsigned int size() const {
+        return (unsigned int)m_Workers.size();
+    }
+
+private:
+    struct Job {
+        virtual ~Job() = default;
+        virtual void run() = 0;
+    };
+
+    template<typename F>
+    struct CallableJob : Job {
+        F callable;
+        explicit CallableJob(F f) : callable(std::move(f)) {}
+        void run() override { callable(); }
+    };
+
+    std::vector<std::thread> m_Workers;
+    std::deque<std::unique_ptr<Job>> m_Jobs;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Stopping = false;
+
+    void work() {
+        for (;;) {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [this] { return m_Stopping || !m_Jobs.empty(); });
+                if (m_Jobs.empty()) {
+                    return;
+                }
+                job = std::move(m_Jobs.front());
+                m_Jobs.pop_front();
+            }
+            job->run();
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_THREADPOOL_H
@@ -0,0 +1,85 @@
+#ifndef PROJECT_BASE_VERTEXPACKING_H
+#define PROJECT_BASE_VERTEXPACKING_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace rg {
+
+// Scalar encoders for the packed vertex layout. Every encoding here is one the GL can decode in the vertex fetch
+// (normalized integers, half floats), except octahedral vectors which the vertex shader unfolds (octDecode in
+// vertexShader.vs / multi_lights.vs).
+
+// round-to-nearest-even float -> IEEE half, as read by GL_HALF_FLOAT attributes
+inline uint16_t packHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    int32_t exponent = (int32_t)biased - 127 + 15;
+
+    if (biased == 0xff) {
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if (exponent <= 0) {
+        // subnormal half
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1))) {
+            ++half;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        ++half; // a carry into the exponent is still the correctly rounded value
+    }
+    return (uint16_t)half;
+}
+
+// [-1, 1] -> GL_SHORT normalized
+inline int16_t packSnorm16(float value) {
+    value = std::fmin(std::fmax(value, -1.0f), 1.0f);
+    return (int16_t)std::lround(value * 32767.0f);
+}
+
+// [0, 1] -> GL_UNSIGNED_SHORT normalized
+inline uint16_t packUnorm16(float value) {
+    value = std::fmin(std::fmax(value, 0.0f), 1.0f);
+    return (uint16_t)std::lround(value * 65535.0f);
+}
+
+// unit vector -> point on the octahedron folded into [-1, 1]^2, https://jcgt.org/published/0003/02/01/
+inline glm::vec2 octEncode(const glm::vec3 &v) {
+    float sum = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f, 0.0f); // degenerate input decodes as +Z
+    }
+    float x = v.x / sum, y = v.y / sum;
+    if (v.z < 0.0f) {
+        float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    return glm::vec2(x, y);
+}
+
+}
+
+#endif //PROJECT_BASE_VERTEXPACKING_H
@@ -0,0 +1,181 @@
+#ifndef PROJECT_BASE_VOXELGRID_H
+#define PROJECT_BASE_VOXELGRID_H
+
+#include <glm/glm.hpp>
+
+#include <rg/StaticGeometry.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace rg {
+
+// Occupancy grid of equally sized boxes, each with a texture, turned into a minimal surface: faces between two
+// occupied cells are dropped and the remaining coplanar faces with the same texture are greedily merged into
+// large quads. Texture coordinates count cells, so with GL_REPEAT a merged quad looks exactly like the unit
+// cube faces it replaces (same orientation as the cube in main.cpp).
+class VoxelGrid {
+public:
+    // cell (i, j, k) spans origin + (i, j, k) * cellSize to origin + (i + 1, j + 1, k + 1) * cellSize
+    VoxelGrid(const glm::vec3 &origin, const glm::vec3 &cellSize)
+            : m_Origin(origin), m_CellSize(cellSize) {
+    }
+
+    // fills the cell containing `center`, `texture` may also be a texture array layer (see StaticGeometry)
+    void set(const glm::vec3 &center, unsigned int texture) {
+        glm::vec3 cell = (center - m_Origin) / m_CellSize;
+        m_Cells[Cell((int)std::floor(cell.x), (int)std::floor(cell.y), (int)std::floor(cell.z))] = texture + 1;
+    }
+
+    size_t cellCount() const {
+        return m_Cells.size();
+    }
+
+    // adds the merged surface to `shell`, one triangle list per texture
+    void mesh(StaticGeometry &shell) const {
+        if (m_Cells.empty()) {
+            return;
+        }
+
+        // dense copy of the occupied bounds
+        int low[3], high[3];
+        std::tie(low[0], low[1], low[2]) = m_Cells.begin()->first;
+        std::tie(high[0], high[1], high[2]) = m_Cells.begin()->first;
+        for (const auto &entry : m_Cells) {
+            int cell[3];
+            std::tie(cell[0], cell[1], cell[2]) = entry.first;
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = std::min(low[axis], cell[axis]);
+                high[axis] = std::max(high[axis], cell[axis]);
+            }
+        }
+        int size[3] = { high[0] - low[0] + 1, high[1] - low[1] + 1, high[2] - low[2] + 1 };
+        std::vector<unsigned int> grid((size_t)size[0] * size[1] * size[2], 0);
+        for (const auto &entry : m_Cells) {
+            int cell[3];
+            std::tie(cell[0], cell[1], cell[2]) = entry.first;
+            grid[index(size, cell[0] - low[0], cell[1] - low[1], cell[2] - low[2])] = entry.second;
+        }
+        auto at = [&](int x[3]) -> unsigned int {
+            if (x[0] < 0 || x[1] < 0 || x[2] < 0 || x[0] >= size[0] || x[1] >= size[1] || x[2] >= size[2]) {
+                return 0;
+            }
+            return grid[index(size, x[0], x[1], x[2])];
+        };
+
+        std::map<unsigned int, std::vector<float>> surfaces;
+        std::vector<unsigned int> mask;
+        for (int d = 0; d < 3; ++d) {
+            // the face's own axes, u x v points along +d except for d == 1
+            int u = d == 0 ? 1 : 0;
+            int v = d == 2 ? 1 : 2;
+            mask.assign((size_t)size[u] * size[v], 0);
+            for (int side = -1; side <= 1; side += 2) {
+                for (int slice = 0; slice < size[d]; ++slice) {
+                    // faces of this slice that look into an empty cell
+                    int x[3];
+                    x[d] = slice;
+                    for (x[v] = 0; x[v] < size[v]; ++x[v]) {
+                        for (x[u] = 0; x[u] < size[u]; ++x[u]) {
+                            unsigned int texture = at(x);
+                            int neighbour[3] = { x[0], x[1], x[2] };
+                            neighbour[d] += side;
+                            mask[(size_t)x[v] * size[u] + x[u]] = texture && !at(neighbour) ? texture : 0;
+                        }
+                    }
+
+                    // grow each face as wide, then as tall as the same texture allows
+                    for (int j = 0; j < size[v]; ++j) {
+                        for (int i = 0; i < size[u];) {
+                            unsigned int texture = mask[(size_t)j * size[u] + i];
+                            if (!texture) {
+                                ++i;
+                                continue;
+                            }
+                            int width = 1;
+                            while (i + width < size[u] && mask[(size_t)j * size[u] + i + width] == texture) {
+                                ++width;
+                            }
+                            int height = 1;
+                            for (; j + height < size[v]; ++height) {
+                                bool same = true;
+                                for (int k = 0; k < width && same; ++k) {
+                                    same = mask[(size_t)(j + height) * size[u] + i + k] == texture;
+                                }
+                                if (!same) {
+                                    break;
+                                }
+                            }
+                            for (int h = 0; h < height; ++h) {
+                                std::fill_n(mask.begin() + (size_t)(j + h) * size[u] + i, width, 0u);
+                            }
+
+                            float plane = (float)(low[d] + slice + (side > 0 ? 1 : 0));
+                            emitQuad(surfaces[texture], d, u, v, side, plane,
+                                     (float)(low[u] + i), (float)(low[v] + j), width, height);
+                            i += width;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (auto &surface : surfaces) {
+            shell.add(surface.first - 1, std::move(surface.second));
+        }
+    }
+
+private:
+    typedef std::tuple<int, int, int> Cell;
+
+    glm::vec3 m_Origin;
+    glm::vec3 m_CellSize;
+    std::map<Cell, unsigned int> m_Cells; // texture + 1, so 0 marks an empty cell in mesh()
+
+    static size_t index(const int size[3], int x, int y, int z) {
+        return ((size_t)z * size[1] + y) * size[0] + x;
+    }
+
+    // two triangles covering width x height cells starting at cell (u0, v0) of the plane at `plane` along d
+    void emitQuad(std::vector<float> &out, int d, int u, int v, int side, float plane,
+                  float u0, float v0, int width, int height) const {
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        normal[d] = (float)side;
+        // (u, v) corner offsets in cells, counter-clockwise seen from the side the face looks to
+        int corners[4][2] = { { 0, 0 }, { width, 0 }, { width, height }, { 0, height } };
+        bool flip = (side < 0) != (d == 1);
+        int order[6] = { 0, 1, 2, 2, 3, 0 };
+        if (flip) {
+            std::swap(order[1], order[2]);
+            std::swap(order[4], order[5]);
+        }
+
+        for (int n : order) {
+            float cell[3];
+            cell[d] = plane;
+            cell[u] = u0 + corners[n][0];
+            cell[v] = v0 + corners[n][1];
+            glm::vec3 position = m_Origin + glm::vec3(cell[0], cell[1], cell[2]) * m_CellSize;
+            // the cube maps z faces as (x, y), x faces as (y, -z) and y faces as (x, -z)
+            float s, t;
+            if (d == 2) {
+                s = (float)corners[n][0];
+                t = (float)corners[n][1];
+            } else {
+                s = (float)corners[n][0];
+                t = (float)(height - corners[n][1]);
+            }
+            float vertex[StaticGeometry::FloatsPerVertex] = {
+                    position.x, position.y, position.z, normal[0], normal[1], normal[2], s, t
+            };
+            out.insert(out.end(), vertex, vertex + StaticGeometry::FloatsPerVertex);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_VOXELGRID_H
@@ -1,10 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+// per-instance model matrix, see rg::InstanceBatch
+layout (location = 5) in mat4 aInstanceModel;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame camera, see rg::CameraBuffer
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
 
 void main() {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = viewProjection * aInstanceModel * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -4,6 +4,16 @@ out vec4 FragColor;
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+flat in float Layer;
+
+// per-frame camera, see rg::CameraBuffer
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
 
 struct DirLight {
     vec3 direction;
@@ -50,16 +60,33 @@ struct Material {
 uniform DirLight dirLight;
 uniform PointLight pointLights[POINT_LIGHT];
 uniform SpotLight spotLight;
-uniform vec3 viewPos;
 uniform Material material;
+// the shell's materials, on unit 2 so they never share a unit with the sampler2Ds above
+uniform sampler2DArray materialLayers;
+
+// The shell has no specular maps of its own. Before it used materialLayers it sampled whatever map the last model
+// left on unit 1, mostly dark and different every frame, so layered geometry gets this faint fixed highlight instead.
+const vec3 LayerSpecular = vec3(0.1);
+
+// material colours at this fragment, from the 2D samplers or the layer of materialLayers
+vec3 diffuseColor;
+vec3 specularColor;
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main() {
+    if (Layer >= 0.0) {
+        diffuseColor = vec3(texture(materialLayers, vec3(TexCoords, Layer)));
+        specularColor = LayerSpecular;
+    } else {
+        diffuseColor = vec3(texture(material.diffuse, TexCoords));
+        specularColor = vec3(texture(material.specular, TexCoords));
+    }
+
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
     vec3 result;
 
     result = CalcDirLight(dirLight, norm, viewDir);
@@ -78,9 +105,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir) {
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     return (ambient + diffuse + specular);
 }
@@ -95,9 +122,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -120,9 +147,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -1,20 +1,48 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// texture array layer, see rg::StaticGeometry
+layout (location = 9) in float aLayer;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out float Layer; // -1 for the 2D material samplers
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame camera, see rg::CameraBuffer
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+// set by Mesh::Draw for meshes uploaded as PackedVertex: aPos.xyz is then normalized to the mesh bounds
+// and aNormal.xy holds an octahedral-encoded normal
+uniform bool packedVertex;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+// set by rg::StaticGeometry for geometry baked against a texture array
+uniform bool layeredMaterial;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 position = packedVertex ? aPos.xyz * positionScale + positionOffset : aPos.xyz;
+    vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
     TexCoords = aTexCoords;
+    Layer = layeredMaterial ? aLayer : -1.0;
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#version 420 core
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shader_draw_parameters : require
+// multi_lights.vs for rg::RenderQueue's multi-draw path, the per-draw uniforms come from a storage buffer
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// texture array layer, see rg::StaticGeometry
+layout (location = 9) in float aLayer;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out float Layer; // -1 for the 2D material samplers
+
+// per-frame camera, see rg::CameraBuffer
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+// positionScale.w is 1 for meshes uploaded as PackedVertex, positionOffset.w for texture array layers,
+// see multi_lights.vs
+struct DrawData {
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+
+layout (std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+
+// index of the call's first command, gl_DrawIDARB counts from 0 in every call
+uniform int drawOffset;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    DrawData draw = draws[drawOffset + gl_DrawIDARB];
+    bool packedVertex = draw.positionScale.w > 0.5;
+    vec3 position = packedVertex ? aPos.xyz * draw.positionScale.xyz + draw.positionOffset.xyz : aPos.xyz;
+    vec3 normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
+    FragPos = vec3(draw.model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(draw.model))) * normal;
+    TexCoords = aTexCoords;
+    Layer = draw.positionOffset.w > 0.5 ? aLayer : -1.0;
+
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -1,15 +1,27 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame camera, see rg::CameraBuffer
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+// set by Mesh::Draw for meshes uploaded as PackedVertex: aPos.xyz is then normalized to the mesh bounds
+uniform bool packedVertex;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 void main() {
+    vec3 position = packedVertex ? aPos.xyz * positionScale + positionOffset : aPos.xyz;
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(position, 1.0);
 }
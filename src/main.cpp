@@ -15,9 +15,23 @@
 #include <rg/Camera.h>
 #include <rg/Function.h>
 #include <learnopengl/model.h>
+#include <rg/CameraBuffer.h>
+#include <rg/GLState.h>
 #include <rg/Function.h>
+#include <rg/FrustumCuller.h>
+#include <rg/InstanceBatch.h>
+#include <rg/ModelLoader.h>
+#include <rg/PortalsDebug.h>
+#include <rg/RenderQueue.h>
+#include <rg/Scene.h>
+#include <rg/StaticGeometry.h>
+#include <rg/StreamBuffer.h>
+#include <rg/TextureArray.h>
+#include <rg/TextureRegistry.h>
+#include <rg/TextureService.h>
 
 #include <iostream>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -26,6 +40,8 @@ void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 unsigned int loadCubemap(vector<std::string> &faces);
+void setupCubeAttributes();
+void setupLightCubeAttributes();
 
 // settings
 const unsigned int SCR_WIDTH = 1200;
@@ -55,6 +71,9 @@ struct ProgramState {
     glm::vec3 elevatorPosition = glm::vec3(-9.8f, -6.0f, 7.6f);
     glm::vec3 doorPosition = glm::vec3(-4.8f, 2.32f, -3.28f);
     glm::mat4 view;
+    std::vector<std::pair<std::string, const Model*>> lodModels; // listed in the LOD panel
+    rg::Scene *scene = nullptr;
+    bool showCells = false; // outlines the scene's portal cells
 
     void SaveToDisk(std::string path);
     void LoadFromDisk(std::string path);
@@ -127,6 +146,8 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // per-frame uniforms and draw data are streamed through this
+    rg::StreamBuffer::instance().init((GLADloadproc)glfwGetProcAddress);
 
     // stbi_set_flip_vertically_on_load(true);
 
@@ -169,16 +190,47 @@ int main() {
                             FileSystem::getPath("resources/shaders/framebufferEffect.fs").c_str());
     Shader lightingShader(FileSystem::getPath("resources/shaders/multi_lights.vs").c_str(),
                           FileSystem::getPath("resources/shaders/multi_lights.fs").c_str());
-    Model sofaModel(FileSystem::getPath("resources/objects/sofa/sofa2.obj").c_str());
-    Model chairModel(FileSystem::getPath("resources/objects/chair/Wooden Chair.obj").c_str());
-    Model stairsModel(FileSystem::getPath("resources/objects/stairs/staircase_180_long.obj").c_str());
-    Model tableModel(FileSystem::getPath("resources/objects/table/wood.table.obj").c_str());
-    Model deskModel(FileSystem::getPath("resources/objects/desk/CoffeeTable1.obj").c_str());
-    Model tvModel(FileSystem::getPath("resources/objects/tv/TV set N140418.obj").c_str());
-    Model bedModel(FileSystem::getPath("resources/objects/bed/Bed actual design apriori S N230720.obj").c_str());
-    Model lockerModel(FileSystem::getPath("resources/objects/locker/Locker 1.obj").c_str());
-    Model bedsideTableModel(FileSystem::getPath("resources/objects/bedside_table/Locker 2.obj").c_str());
-    Model elevatorModel(FileSystem::getPath("resources/objects/elevator/untitled.obj").c_str());
+    Shader debugLinesShader(FileSystem::getPath("resources/shaders/debug_lines.vs").c_str(),
+                            FileSystem::getPath("resources/shaders/debug_lines.fs").c_str());
+    // view and projection come from the shared camera buffer
+    for (const Shader *program : {&shader, &lightShader, &skyboxShader, &shaderCubeMaps, &lightingShader, &debugLinesShader}) {
+        rg::CameraBuffer::attach(program->ID);
+    }
+    rg::PortalsDebug portalsDebug; // draws with debugLinesShader
+    // where the context allows it, the queue draws lightingShader's meshes with glMultiDrawElementsIndirect
+    // and this variant, which reads the per-draw uniforms from a storage buffer
+    std::unique_ptr<Shader> indirectLightingShader;
+    if (rg::RenderQueue::supportsMultiDrawIndirect()) {
+        indirectLightingShader.reset(new Shader(FileSystem::getPath("resources/shaders/multi_lights_indirect.vs").c_str(),
+                                                FileSystem::getPath("resources/shaders/multi_lights.fs").c_str()));
+        rg::CameraBuffer::attach(indirectLightingShader->ID);
+        rg::RenderQueue::instance().enableMultiDrawIndirect((GLADloadproc)glfwGetProcAddress, lightingShader,
+                                                           *indirectLightingShader);
+    }
+    // model textures are bound to fixed units, the programs drawing models get their samplers pointed at them once
+    for (const Shader *program : {&shader, &lightingShader, indirectLightingShader.get()}) {
+        if (program) {
+            setMaterialSamplers(*program);
+        }
+    }
+    // furniture placement comes from the scene file. Its models are imported in parallel, only the GL uploads
+    // happen on this thread. They are uploaded in the packed vertex layout, vertexShader.vs decodes it.
+    rg::Scene scene;
+    scene.load(FileSystem::getPath("resources/scene.txt"));
+    {
+        rg::ModelLoader modelLoader;
+        scene.loadModels(modelLoader, VertexFormat::Packed);
+        modelLoader.finish();
+    }
+    rg::MeshCache::printStats();
+    rg::GeometryArena::instance().printStats();
+    for (unsigned int i = 0; i < scene.modelCount(); ++i) {
+        programState->lodModels.emplace_back(scene.modelName(i), &scene.model(i));
+    }
+    programState->scene = &scene;
+    // the scene's cells and portals hide what is only behind closed walls, for the shell as much as the furniture
+    rg::FrustumCuller::instance().setPortals(&scene.portals());
+    int elevatorNode = scene.find("elevator");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -333,14 +385,7 @@ int main() {
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    setupCubeAttributes();
 
     glBindVertexArray(0);
 
@@ -352,26 +397,15 @@ int main() {
     glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(floorVertices), &floorVertices, GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    setupCubeAttributes();
 
     glBindVertexArray(0);
 
-    // lightCube VAO
-    unsigned int lightVAO;
-    glGenVertexArrays(1, &lightVAO);
-    glBindVertexArray(lightVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // light markers, drawn instanced
+    const rg::VertexLayout lightCubeLayout = { 8 * sizeof(float), setupLightCubeAttributes };
+    rg::InstanceBatch lightCubes;
+    function.settingUpLight(lightCubes);
+    lightCubes.upload(cubeVBO, lightCubeLayout, 36);
 
     // skybox VAO
     unsigned int skyboxVAO, skyboxVBO;
@@ -401,12 +435,33 @@ int main() {
 
     // load textures
     // -------------
-    unsigned int wall = loadTexture(FileSystem::getPath("resources/textures/wall.jpg").c_str());
-    unsigned int floor = loadTexture(FileSystem::getPath("resources/textures/floor.png").c_str());
-    unsigned int tile = loadTexture(FileSystem::getPath("resources/textures/tile.png").c_str());
-    unsigned int stone = loadTexture(FileSystem::getPath("resources/textures/stone.jpg").c_str());
-    unsigned int wood = loadTexture(FileSystem::getPath("resources/textures/Wooden_Chair_default.png").c_str());
     unsigned int glass = loadTexture(FileSystem::getPath("resources/textures/glass.jpg").c_str());
+    // the shell's materials are layers of one texture array, so the whole shell is drawn under a single binding
+    rg::TextureArray shellTextures;
+    unsigned int wall = shellTextures.add(FileSystem::getPath("resources/textures/wall.jpg"));
+    unsigned int floor = shellTextures.add(FileSystem::getPath("resources/textures/floor.png"));
+    unsigned int tile = shellTextures.add(FileSystem::getPath("resources/textures/tile.png"));
+    unsigned int stone = shellTextures.add(FileSystem::getPath("resources/textures/stone.jpg"));
+    unsigned int wood = shellTextures.add(FileSystem::getPath("resources/textures/Wooden_Chair_default.png"));
+    shellTextures.load();
+
+    // the static building shell, baked into world space once
+    const rg::StaticGeometry::Shape cubeShape = { cubeVertices, sizeof(cubeVertices) / sizeof(float) / rg::StaticGeometry::FloatsPerVertex };
+    const rg::StaticGeometry::Shape floorShape = { floorVertices, sizeof(floorVertices) / sizeof(float) / rg::StaticGeometry::FloatsPerVertex };
+    rg::StaticGeometry shell;
+    shell.setTextureArray(shellTextures.id());
+    shell.setCells(scene.portals());
+    function.settingUpFloor(shell, floorShape, floor);
+    rg::VoxelGrid walls(glm::vec3(0.0f), glm::vec3(1.0f));
+    function.settingUpWall(walls, tile, wall, 0.5f);
+    function.settingUpWall(walls, tile, wall, 6.5f);
+    walls.mesh(shell);
+    function.settingUpPillar(shell, stone);
+    function.settingUpTilesInPillar(shell, cubeShape, wood);
+    function.settingUpTilesInWall(shell, cubeShape, tile);
+    function.settingUpRoof(shell, cubeShape, tile);
+    shell.bake();
+    shell.printStats();
 
     vector<std::string> faces {
         FileSystem::getPath("resources/textures/space/right.jpg").c_str(),
@@ -437,9 +492,38 @@ int main() {
     screenShaderNext.use();
     screenShaderNext.setInt("screenTexture", 0);
 
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
+    // uniforms set every frame, resolved once per program that draws lit meshes
+    struct PointLightUniforms {
+        Shader::Uniform position, ambient, diffuse, specular, constant, linear, quadratic;
+    };
+    struct LitProgram {
+        const Shader *shader;
+        PointLightUniforms pointLights[4];
+    };
+    std::vector<LitProgram> litPrograms;
+    for (const Shader *program : {&lightingShader, indirectLightingShader.get()}) {
+        if (!program) {
+            continue;
+        }
+        program->use();
+        program->setInt("material.diffuse", 0);
+        program->setInt("material.specular", 1);
+        program->setInt("materialLayers", rg::StaticGeometry::LayerUnit);
+
+        LitProgram lit;
+        lit.shader = program;
+        for (int i = 0; i < 4; i++) {
+            std::string light = "pointLights[" + std::to_string(i) + "].";
+            lit.pointLights[i].position = program->uniform(light + "position");
+            lit.pointLights[i].ambient = program->uniform(light + "ambient");
+            lit.pointLights[i].diffuse = program->uniform(light + "diffuse");
+            lit.pointLights[i].specular = program->uniform(light + "specular");
+            lit.pointLights[i].constant = program->uniform(light + "constant");
+            lit.pointLights[i].linear = program->uniform(light + "linear");
+            lit.pointLights[i].quadratic = program->uniform(light + "quadratic");
+        }
+        litPrograms.push_back(lit);
+    }
 
     // create framebuffer object
     unsigned int fbo;
@@ -503,12 +587,23 @@ int main() {
         // -----
         processInput(window);
 
+        // binds and state changes of the frame go through the cache, which drops the redundant ones
+        rg::GLState &gl = rg::GLState::instance();
+        gl.beginFrame();
+
+        // stream in textures that finished decoding since the last frame, identical ones are merged into one
+        rg::TextureService::instance().update();
+        rg::TextureRegistry &textures = rg::TextureRegistry::instance();
+        textures.update();
+        glass = textures.resolve(glass);
+        cubemapTexture = textures.resolve(cubemapTexture);
+
         // render
         // ------
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        gl.bindFramebuffer(GL_FRAMEBUFFER, fbo);
         // check this function
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glEnable(GL_DEPTH_TEST);
+        gl.enable(GL_DEPTH_TEST);
 
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -516,46 +611,27 @@ int main() {
         // BEGIN DRAW SCENE
         shader.use();
 
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", programState->camera.Position);
-        lightingShader.setFloat("material.shininess", 32.0f);
-
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -1.0f);
-        lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-        lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-        lightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[0].diffuse", 0.5f, 0.5f, 0.5f);
-        lightingShader.setVec3("pointLights[0].specular", 0.8f, 0.8f, 0.8f);
-        lightingShader.setFloat("pointLights[0].constant", 1.0f);
-        lightingShader.setFloat("pointLights[0].linear", 0.09);
-        lightingShader.setFloat("pointLights[0].quadratic", 0.032);
-
-        lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-        lightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[1].diffuse", 0.5f, 0.5f, 0.5f);
-        lightingShader.setVec3("pointLights[1].specular", 0.8f, 0.8f, 0.8f);
-        lightingShader.setFloat("pointLights[1].constant", 1.0f);
-        lightingShader.setFloat("pointLights[1].linear", 0.09);
-        lightingShader.setFloat("pointLights[1].quadratic", 0.032);
-
-        lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-        lightingShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[2].diffuse", 0.5f, 0.5f, 0.5f);
-        lightingShader.setVec3("pointLights[2].specular", 0.8f, 0.8f, 0.8f);
-        lightingShader.setFloat("pointLights[2].constant", 1.0f);
-        lightingShader.setFloat("pointLights[2].linear", 0.09);
-        lightingShader.setFloat("pointLights[2].quadratic", 0.032);
-
-        lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-        lightingShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[3].diffuse", 0.5f, 0.5f, 0.5f);
-        lightingShader.setVec3("pointLights[3].specular", 0.8f, 0.8f, 0.8f);
-        lightingShader.setFloat("pointLights[3].constant", 1.0f);
-        lightingShader.setFloat("pointLights[3].linear", 0.09);
-        lightingShader.setFloat("pointLights[3].quadratic", 0.032);
+        for (const LitProgram &lit : litPrograms) {
+            const Shader &program = *lit.shader;
+            program.use();
+            program.setFloat("material.shininess", 32.0f);
+
+            program.setVec3("dirLight.direction", -0.2f, -1.0f, -1.0f);
+            program.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
+            program.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
+            program.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+
+            for (int i = 0; i < 4; i++) {
+                const PointLightUniforms &light = lit.pointLights[i];
+                program.setVec3(light.position, pointLightPositions[i]);
+                program.setVec3(light.ambient, 0.05f, 0.05f, 0.05f);
+                program.setVec3(light.diffuse, 0.5f, 0.5f, 0.5f);
+                program.setVec3(light.specular, 0.8f, 0.8f, 0.8f);
+                program.setFloat(light.constant, 1.0f);
+                program.setFloat(light.linear, 0.09);
+                program.setFloat(light.quadratic, 0.032);
+            }
+        }
 
 //        lightingShader.setVec3("pointLights[4].position", pointLightPositions[4]);
 //        lightingShader.setVec3("pointLights[4].ambient", 0.05f, 0.05f, 0.05f);
@@ -660,161 +736,67 @@ int main() {
         programState->view = programState->camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 model = glm::mat4(1.0f);
-
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", programState->view);
-        lightingShader.setMat4("model", model);
-
-        // sofa
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadSofa(sofaModel, model, shader);
-
-        // chairs
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadFirstChair(chairModel, model, shader);
-
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadSecondChair(chairModel, model, shader);
-
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadThirdChair(chairModel, model, shader);
-
-        // table
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadTable(tableModel, model, shader);
-
-        // stairs
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadStairs(stairsModel, model, shader);
-
-        // desk
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadDesk(deskModel, model, shader);
-
-        // tv
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadTv(tvModel, model, shader);
-
-        // bed
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadBed(bedModel, model, shader);
-
-        // locker
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadLocker(lockerModel, model, shader);
-
-        // bedside_tables
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadFirstBedsideTable(bedsideTableModel, model, shader);
-
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadSecondBedsideTable(bedsideTableModel, model, shader);
-
-        // elevator
-        shader.setMat4("view", programState->view);
-        shader.setMat4("projection", projection);
-        model = glm::mat4(1.0f);
-        function.loadElevator(elevatorModel, model, shader, programState->elevatorPosition, programState->speed * deltaTime, programState->start);
+        rg::StreamBuffer::instance().beginFrame();
+        rg::CameraBuffer::instance().update(programState->view, projection, programState->camera.Position, currentFrame);
+        rg::LodSelector::instance().beginFrame(programState->camera.Position, glm::radians(programState->camera.Zoom), (float)SCR_HEIGHT);
+        // everything below is only submitted, the queue sorts it by state and draws it at once
+        rg::RenderQueue &queue = rg::RenderQueue::instance();
+        queue.beginFrame(programState->camera.Position, 100.0f);
+        // the scene and the shell leave out what the camera can't see, directly or through the portals
+        // from the same projection as the camera buffer, so culling can't drift from what is drawn
+        glm::mat4 viewProjection = projection * programState->view;
+        rg::Frustum view = programState->camera.GetFrustum(projection);
+        scene.portals().beginFrame(viewProjection, view, programState->camera.Position);
+        rg::FrustumCuller::instance().beginFrame(view);
+
+        // furniture, only the elevator moves
+        function.moveElevator(programState->elevatorPosition, programState->speed * deltaTime, programState->start);
+        if (elevatorNode >= 0) {
+            scene.setPosition(elevatorNode, programState->elevatorPosition);
+        }
+        scene.update();
+        scene.submit(queue, lightingShader);
 
         // elevatorDoor
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, glass);
-        function.settingUpElevatorDoor(shader, model, programState->doorPosition, programState->open, programState->speed * deltaTime, programState->start);
-        glBindVertexArray(0);
-
-        // floor
-        glBindVertexArray(floorVAO);
-        function.settingUpFloor(shader, model, floor);
-        glBindVertexArray(0);
-
-        // wall
-        glBindVertexArray(cubeVAO);
-        function.settingUpWall(shader, model, tile, wall, 0.5f);
-        function.settingUpPillar(shader, model, stone);
-        function.settingUpWall(shader, model, tile, wall, 6.5f);
-        glBindVertexArray(0);
-
-        // tiles
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, wood);
-        function.settingUpTilesInPillar(shader, model);
-        glBindTexture(GL_TEXTURE_2D, tile);
-        function.settingUpTilesInWall(shader, model);
-        glBindVertexArray(0);
-
-        // roof
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, tile);
-        function.settingUpRoof(shader, model);
-        glBindVertexArray(0);
+        function.settingUpElevatorDoor(lightingShader, model, programState->doorPosition, programState->open, programState->speed * deltaTime, programState->start,
+                                       cubeVAO, glass);
 
-        // light
-        lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", programState->view);
-        glBindVertexArray(lightVAO);
-        function.settingUpLight(lightShader, model);
-        glBindVertexArray(0);
+        // floors, walls, pillars, tiles and roof, already in world space
+        shell.submit(queue, lightingShader);
 
-        if (programState->ImGuiEnabled) {
-            ElevatorImGui(programState);
-        }
+        // light
+        lightCubes.submit(queue, lightShader);
 
         // window
-        shaderCubeMaps.use();
-        programState->view = programState->camera.GetViewMatrix();
-        projection = glm::perspective(glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        shaderCubeMaps.setMat4("view", programState->view);
-        shaderCubeMaps.setMat4("projection", projection);
-        shaderCubeMaps.setVec3("cameraPos", programState->camera.Position);
-
-        glBindVertexArray(floorVAO);
-        glActiveTexture(GL_TEXTURE0);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 6.0f, 0.0f));
-        shaderCubeMaps.setMat4("model", model);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        rg::RenderQueue::Item windowPane;
+        windowPane.shader = &shaderCubeMaps;
+        windowPane.vao = floorVAO;
+        windowPane.textureTarget = GL_TEXTURE_CUBE_MAP;
+        windowPane.textures[0] = cubemapTexture;
+        windowPane.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 6.0f, 0.0f));
+        windowPane.draw = rg::RenderQueue::drawArrays;
+        windowPane.count = 6;
+        queue.submit(rg::RenderQueue::Opaque, windowPane, glm::vec3(0.0f, 6.0f, 0.0f));
 
         // skybox draw
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        skyboxShader.setMat4("view", glm::mat4(glm::mat3(programState->view)));
-        skyboxShader.setMat4("projection", projection);
-
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
+        rg::RenderQueue::Item skybox;
+        skybox.shader = &skyboxShader;
+        skybox.vao = skyboxVAO;
+        skybox.textureTarget = GL_TEXTURE_CUBE_MAP;
+        skybox.textures[0] = cubemapTexture;
+        skybox.setModel = false;
+        skybox.draw = rg::RenderQueue::drawArrays;
+        skybox.count = 36;
+        queue.submit(rg::RenderQueue::Sky, skybox, programState->camera.Position);
+
+        queue.flush();
+        if (programState->showCells) {
+            portalsDebug.draw(scene.portals(), debugLinesShader);
+        }
+
+        if (programState->ImGuiEnabled) {
+            ElevatorImGui(programState);
+        }
 
         // kernel effects
         if (programState->effect) {
@@ -843,20 +825,21 @@ int main() {
         // END DRAW SCENE
 
         // unbind framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        gl.bindFramebuffer(GL_FRAMEBUFFER, 0);
         // disable depth test
-        glDisable(GL_DEPTH_TEST); 
+        gl.disable(GL_DEPTH_TEST);
         // clear all relevant buffers
         // glClearColor(1.0f, 1.0f, 1.0f, 1.0f); 
         glClear(GL_COLOR_BUFFER_BIT);
 
         // map on screen : bottom left -> top right
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, textureColorBuffer);
+        gl.bindVertexArray(quadVAO);
+        gl.bindTexture(0, GL_TEXTURE_2D, textureColorBuffer);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        rg::StreamBuffer::instance().endFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -874,13 +857,24 @@ int main() {
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &floorVAO);
-    glDeleteVertexArrays(1, &lightVAO);
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &floorVBO);
     glDeleteBuffers(1, &skyboxVBO);
     glDeleteBuffers(1, &quadVBO);
+    rg::TextureRegistry &textures = rg::TextureRegistry::instance();
+    textures.release(glass);
+    textures.release(cubemapTexture);
+    scene.unload();
+    textures.shutdown();
+    rg::TextureService::instance().shutdown();
+    rg::GeometryArena::instance().shutdown();
+    rg::StreamBuffer::instance().shutdown();
+    shell.destroy();
+    portalsDebug.destroy();
+    shellTextures.destroy();
+    lightCubes.destroy();
 
     glfwTerminate();
 
@@ -916,6 +910,67 @@ void ElevatorImGui(ProgramState* programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("LOD");
+
+        ImGui::SliderFloat("LOD bias", &rg::LodSelector::instance().bias, -2.0f, 4.0f);
+        if (programState->scene) {
+            const rg::Scene::Stats &scene = programState->scene->stats();
+            ImGui::Text("Scene: %u nodes (%u dynamic), %u transforms updated", scene.nodes, scene.dynamicNodes, scene.updated);
+        }
+        for (const auto &entry : programState->lodModels) {
+            std::vector<size_t> triangles = entry.second->lodTriangleCounts();
+            std::string levels;
+            for (size_t level = 0; level < triangles.size(); ++level) {
+                levels += (level ? " / " : "") + std::to_string(triangles[level]);
+            }
+            ImGui::Text("%s: LOD %u, triangles %s", entry.first.c_str(), entry.second->currentLod(), levels.c_str());
+        }
+
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Render queue");
+
+        const rg::RenderQueue::Stats &stats = rg::RenderQueue::instance().stats();
+        const rg::FrustumCuller::Stats &culling = rg::FrustumCuller::instance().stats();
+        ImGui::Checkbox("Frustum culling", &rg::FrustumCuller::instance().enabled);
+        ImGui::Text("%u of %u bounding boxes visible, %u culled, %u BVH nodes visited", culling.visible, culling.tested,
+                    culling.culled(), culling.nodesVisited);
+        if (programState->scene) {
+            const rg::Scene::Stats &sceneStats = programState->scene->stats();
+            ImGui::Text("%u mesh bounds in a BVH of %u nodes", sceneStats.meshBounds, sceneStats.bvhNodes);
+            rg::Portals &portals = programState->scene->portals();
+            const rg::Portals::Stats &cells = portals.stats();
+            ImGui::Checkbox("Portal culling", &portals.enabled);
+            ImGui::SameLine();
+            ImGui::Checkbox("Show cells", &programState->showCells);
+            ImGui::Text("Camera in %s, %u of %u cells visible through %u portals, %u boxes hidden",
+                        cells.cameraCell >= 0 ? portals.cell(cells.cameraCell).name.c_str() : "outside",
+                        cells.visibleCells, portals.cellCount() + 1, cells.portalsPassed, culling.portalCulled);
+        }
+        ImGui::Text("%u draws", stats.items);
+        ImGui::Text("%u program, %u VAO, %u texture changes", stats.programChanges, stats.vaoChanges, stats.textureChanges);
+        ImGui::Text("%u state changes saved by sorting (%u unsorted, %u sorted)", stats.saved(), stats.unsortedChanges,
+                    stats.sortedChanges);
+        if (rg::RenderQueue::instance().multiDrawIndirect()) {
+            ImGui::Text("%u draws in %u multi-draw indirect calls", stats.indirectDraws, stats.multiDraws);
+        } else {
+            ImGui::Text("multi-draw indirect unavailable, GL 3.3 path");
+        }
+        const rg::GLState::Stats &gl = rg::GLState::instance().lastFrame();
+        ImGui::Text("GL state: %u calls issued, %u redundant dropped", gl.totalIssued(), gl.totalFiltered());
+        for (unsigned int call = 0; call < rg::GLState::CallCount; ++call) {
+            ImGui::Text("  %s: %u / %u", rg::GLState::callName((rg::GLState::Call)call), gl.issued[call], gl.filtered[call]);
+        }
+        const rg::StreamBuffer &stream = rg::StreamBuffer::instance();
+        ImGui::Text("%zu bytes streamed (%s), %u waits on the GPU", stream.stats().bytes,
+                    stream.persistent() ? "persistent" : "orphaned", stream.stats().waits);
+
+        ImGui::End();
+    }
+
     if (programState->open && programState->doorPosition.z == -2.0f) {
         ImGui::Begin("Lift");
 
@@ -1041,67 +1096,31 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 }
 
 unsigned int loadCubemap(vector<std::string> &faces) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels, n = faces.size();
-    for (unsigned int i = 0; i < n; ++i) {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height,
-                         0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        }
-        else {
-            std::cerr << "Cube map texture face - load failure!\n";
-
-            return -1;
-        }
-        stbi_image_free(data);
-    }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    // shared through the texture registry, samples as a placeholder until all faces are uploaded
+    return rg::TextureRegistry::instance().acquireCubemap(faces);
 }
 
 // utility function for loading a 2D texture from file
 // ---------------------------------------------------
 unsigned int loadTexture(char const *path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1) {
-            format = GL_RED;
-        } else if (nrComponents == 3) {
-            format = GL_RGB;
-        } else if (nrComponents == 4) {
-            format = GL_RGBA;
-        }
+    // shared through the texture registry, samples as a placeholder until it is uploaded
+    return rg::TextureRegistry::instance().acquire2D(path);
+}
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+// position, normal and texture coordinates of the cube and floor vertices
+void setupCubeAttributes() {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 
-        stbi_image_free(data);
-    }
-    else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+}
 
-    return textureID;
+// the light markers only read positions
+void setupLightCubeAttributes() {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 }